@@ -0,0 +1,548 @@
+/*
+ * Copyright 2026 Porthole contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#include <stdarg.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include <math.h>
+
+#define COBJMACROS
+#include "windef.h"
+#include "winbase.h"
+#include "dcomp_private.h"
+#include "wine/debug.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+WINE_DEFAULT_DEBUG_CHANNEL(dcomp);
+
+#ifndef PF_AVX_INSTRUCTIONS_AVAILABLE
+#define PF_AVX_INSTRUCTIONS_AVAILABLE 39
+#endif
+
+/* Animation objects. An animation is a list of segments, each starting at
+ * an offset in seconds from the beginning of the animation, that the
+ * application builds and may keep changing. Setting it on a property takes
+ * an immutable snapshot of it, an animation_function, which Commit hands to
+ * the compositor with the frame; the compositor evaluates it at every
+ * composition interval, so an animation runs without further commits.
+ *
+ * All the animations of a frame are evaluated at once, in two passes: a
+ * scalar one that finds the current segment of each function and gathers
+ * its local time and coefficients into parallel arrays, and a vector one
+ * that evaluates the cubics over those arrays several at a time. */
+
+#define ANIMATION_PI 3.14159265358979323846
+
+typedef void (*evaluate_cubics_func)(struct animation_batch *batch, SIZE_T count);
+
+static const struct IDCompositionAnimationVtbl animation_vtbl;
+
+static inline struct composition_animation *impl_from_IDCompositionAnimation(IDCompositionAnimation *iface)
+{
+    return CONTAINING_RECORD(iface, struct composition_animation, IDCompositionAnimation_iface);
+}
+
+struct composition_animation *unsafe_impl_from_IDCompositionAnimation(IDCompositionAnimation *iface)
+{
+    if (!iface || iface->lpVtbl != &animation_vtbl)
+        return NULL;
+    return impl_from_IDCompositionAnimation(iface);
+}
+
+void animation_function_addref(struct animation_function *function)
+{
+    InterlockedIncrement(&function->ref);
+}
+
+void animation_function_release(struct animation_function *function)
+{
+    if (function && !InterlockedDecrement(&function->ref))
+        free(function);
+}
+
+/* Take a snapshot of the animation's segments. The snapshot is kept until
+ * the animation changes, so setting one animation on many properties shares
+ * a single function. Returns NULL if out of memory. */
+struct animation_function *animation_snapshot(struct composition_animation *animation)
+{
+    struct animation_function *function;
+
+    AcquireSRWLockExclusive(&animation->lock);
+    if (!(function = animation->function))
+    {
+        if ((function = malloc(offsetof(struct animation_function, segments[animation->segment_count]))))
+        {
+            function->ref = 1;
+            function->begin_time = animation->begin_time;
+            function->count = animation->segment_count;
+            memcpy(function->segments, animation->segments,
+                    animation->segment_count * sizeof(*animation->segments));
+            animation->function = function;
+        }
+    }
+    if (function)
+        animation_function_addref(function);
+    ReleaseSRWLockExclusive(&animation->lock);
+    return function;
+}
+
+/* Called with the animation lock held. */
+static void animation_changed(struct composition_animation *animation)
+{
+    animation_function_release(animation->function);
+    animation->function = NULL;
+}
+
+/* Append a segment. Segments start in strictly increasing order, and none
+ * follows the end of the animation. */
+static HRESULT animation_add_segment(struct composition_animation *animation,
+        const struct animation_segment *segment)
+{
+    HRESULT hr = S_OK;
+
+    if (!isfinite(segment->begin) || segment->begin < 0.0)
+        return E_INVALIDARG;
+
+    AcquireSRWLockExclusive(&animation->lock);
+    if (animation->ended)
+        hr = E_UNEXPECTED;
+    else if (animation->segment_count && segment->begin <= animation->segments[animation->segment_count - 1].begin)
+        hr = E_INVALIDARG;
+    else if (!dcomp_array_reserve((void **)&animation->segments, &animation->segments_size,
+            animation->segment_count + 1, sizeof(*animation->segments)))
+        hr = E_OUTOFMEMORY;
+    else
+    {
+        animation->segments[animation->segment_count++] = *segment;
+        animation->ended = segment->type == ANIMATION_SEGMENT_END;
+        animation_changed(animation);
+    }
+    ReleaseSRWLockExclusive(&animation->lock);
+    return hr;
+}
+
+static BOOL coefficients_are_finite(const float *coefficients, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!isfinite(coefficients[i]))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static HRESULT STDMETHODCALLTYPE animation_QueryInterface(IDCompositionAnimation *iface, REFIID iid, void **out)
+{
+    TRACE("iface %p, iid %s, out %p\n", iface, debugstr_guid(iid), out);
+
+    if (IsEqualGUID(iid, &IID_IUnknown)
+            || IsEqualGUID(iid, &IID_IDCompositionAnimation))
+    {
+        IUnknown_AddRef(iface);
+        *out = iface;
+        return S_OK;
+    }
+
+    FIXME("%s not implemented, returning E_NOINTERFACE.\n", debugstr_guid(iid));
+    *out = NULL;
+    return E_NOINTERFACE;
+}
+
+static ULONG STDMETHODCALLTYPE animation_AddRef(IDCompositionAnimation *iface)
+{
+    struct composition_animation *animation = impl_from_IDCompositionAnimation(iface);
+    ULONG ref = InterlockedIncrement(&animation->ref);
+
+    TRACE("iface %p, ref %lu.\n", iface, ref);
+    return ref;
+}
+
+static ULONG STDMETHODCALLTYPE animation_Release(IDCompositionAnimation *iface)
+{
+    struct composition_animation *animation = impl_from_IDCompositionAnimation(iface);
+    ULONG ref = InterlockedDecrement(&animation->ref);
+
+    TRACE("iface %p, ref %lu.\n", iface, ref);
+
+    /* Properties hold snapshots, not the animation. */
+    if (!ref)
+    {
+        animation_function_release(animation->function);
+        free(animation->segments);
+        free(animation);
+    }
+
+    return ref;
+}
+
+static HRESULT STDMETHODCALLTYPE animation_Reset(IDCompositionAnimation *iface)
+{
+    struct composition_animation *animation = impl_from_IDCompositionAnimation(iface);
+
+    TRACE("iface %p\n", iface);
+
+    AcquireSRWLockExclusive(&animation->lock);
+    animation->segment_count = 0;
+    animation->begin_time = 0;
+    animation->ended = FALSE;
+    animation_changed(animation);
+    ReleaseSRWLockExclusive(&animation->lock);
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE animation_SetAbsoluteBeginTime(IDCompositionAnimation *iface,
+        LARGE_INTEGER begin_time)
+{
+    struct composition_animation *animation = impl_from_IDCompositionAnimation(iface);
+
+    TRACE("iface %p, begin_time %s\n", iface, wine_dbgstr_longlong(begin_time.QuadPart));
+
+    AcquireSRWLockExclusive(&animation->lock);
+    animation->begin_time = begin_time.QuadPart;
+    animation_changed(animation);
+    ReleaseSRWLockExclusive(&animation->lock);
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE animation_AddCubic(IDCompositionAnimation *iface, double begin_offset,
+        float constant_coefficient, float linear_coefficient, float quadratic_coefficient, float cubic_coefficient)
+{
+    struct composition_animation *animation = impl_from_IDCompositionAnimation(iface);
+    struct animation_segment segment =
+    {
+        .begin = begin_offset,
+        .type = ANIMATION_SEGMENT_CUBIC,
+        .coefficients = {constant_coefficient, linear_coefficient, quadratic_coefficient, cubic_coefficient},
+    };
+
+    TRACE("iface %p, begin_offset %.8e, coefficients {%f, %f, %f, %f}\n", iface, begin_offset,
+            constant_coefficient, linear_coefficient, quadratic_coefficient, cubic_coefficient);
+
+    if (!coefficients_are_finite(segment.coefficients, 4))
+        return E_INVALIDARG;
+    return animation_add_segment(animation, &segment);
+}
+
+static HRESULT STDMETHODCALLTYPE animation_AddSinusoidal(IDCompositionAnimation *iface, double begin_offset,
+        float bias, float amplitude, float frequency, float phase)
+{
+    struct composition_animation *animation = impl_from_IDCompositionAnimation(iface);
+    struct animation_segment segment =
+    {
+        .begin = begin_offset,
+        .type = ANIMATION_SEGMENT_SINUSOIDAL,
+        .coefficients = {bias, amplitude, frequency, phase},
+    };
+
+    TRACE("iface %p, begin_offset %.8e, bias %f, amplitude %f, frequency %f, phase %f\n", iface, begin_offset,
+            bias, amplitude, frequency, phase);
+
+    if (!coefficients_are_finite(segment.coefficients, 4))
+        return E_INVALIDARG;
+    return animation_add_segment(animation, &segment);
+}
+
+static HRESULT STDMETHODCALLTYPE animation_AddRepeat(IDCompositionAnimation *iface, double begin_offset,
+        double duration)
+{
+    struct composition_animation *animation = impl_from_IDCompositionAnimation(iface);
+    struct animation_segment segment =
+    {
+        .begin = begin_offset,
+        .type = ANIMATION_SEGMENT_REPEAT,
+        .duration = duration,
+    };
+
+    TRACE("iface %p, begin_offset %.8e, duration %.8e\n", iface, begin_offset, duration);
+
+    if (!isfinite(duration) || duration <= 0.0)
+        return E_INVALIDARG;
+    return animation_add_segment(animation, &segment);
+}
+
+static HRESULT STDMETHODCALLTYPE animation_End(IDCompositionAnimation *iface, double end_offset, float end_value)
+{
+    struct composition_animation *animation = impl_from_IDCompositionAnimation(iface);
+    struct animation_segment segment =
+    {
+        .begin = end_offset,
+        .type = ANIMATION_SEGMENT_END,
+        .coefficients = {end_value},
+    };
+
+    TRACE("iface %p, end_offset %.8e, end_value %f\n", iface, end_offset, end_value);
+
+    if (!isfinite(end_value))
+        return E_INVALIDARG;
+    return animation_add_segment(animation, &segment);
+}
+
+static const struct IDCompositionAnimationVtbl animation_vtbl =
+{
+    /* IUnknown methods */
+    animation_QueryInterface,
+    animation_AddRef,
+    animation_Release,
+    /* IDCompositionAnimation methods */
+    animation_Reset,
+    animation_SetAbsoluteBeginTime,
+    animation_AddCubic,
+    animation_AddSinusoidal,
+    animation_AddRepeat,
+    animation_End,
+};
+
+HRESULT create_animation(IDCompositionAnimation **out)
+{
+    struct composition_animation *animation;
+
+    if (!out)
+        return E_INVALIDARG;
+
+    if (!(animation = calloc(1, sizeof(*animation))))
+    {
+        *out = NULL;
+        return E_OUTOFMEMORY;
+    }
+
+    animation->IDCompositionAnimation_iface.lpVtbl = &animation_vtbl;
+    InitializeSRWLock(&animation->lock);
+    animation->ref = 1;
+
+    TRACE("created animation %p\n", animation);
+    *out = &animation->IDCompositionAnimation_iface;
+    return S_OK;
+}
+
+/* A segment that holds its value from its start on. */
+static BOOL segment_is_constant(const struct animation_segment *segment)
+{
+    switch (segment->type)
+    {
+        case ANIMATION_SEGMENT_CUBIC:
+            return !segment->coefficients[1] && !segment->coefficients[2] && !segment->coefficients[3];
+        case ANIMATION_SEGMENT_SINUSOIDAL:
+            return !segment->coefficients[1];
+        case ANIMATION_SEGMENT_REPEAT:
+            return FALSE;
+        case ANIMATION_SEGMENT_END:
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* The index of the last segment starting at or before time, or of the first
+ * one if none does. */
+static unsigned int find_segment(const struct animation_function *function, unsigned int end, double time)
+{
+    unsigned int low = 0, high = end, mid;
+
+    while (high - low > 1)
+    {
+        mid = (low + high) / 2;
+        if (function->segments[mid].begin <= time)
+            low = mid;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/* Find the segment of a non-empty function in effect at time, in seconds
+ * from the function's start, and the time within it. A repeat maps the time
+ * back into the span it repeats, which only ever moves it to an earlier
+ * segment. Returns FALSE once the function holds its value for good. */
+static BOOL locate_segment(const struct animation_function *function, double time,
+        const struct animation_segment **segment, double *local)
+{
+    unsigned int index = find_segment(function, function->count, time);
+    BOOL running = index != function->count - 1 || time < function->segments[index].begin
+            || !segment_is_constant(&function->segments[index]);
+    const struct animation_segment *s = &function->segments[index];
+
+    while (s->type == ANIMATION_SEGMENT_REPEAT && index)
+    {
+        time = s->begin - s->duration + fmod(time - s->begin, s->duration);
+        index = find_segment(function, index, time);
+        s = &function->segments[index];
+    }
+
+    *segment = s;
+    *local = max(time - s->begin, 0.0);
+    return running;
+}
+
+static void evaluate_cubics(struct animation_batch *batch, SIZE_T count)
+{
+    SIZE_T i;
+
+    for (i = 0; i < count; i++)
+        batch->values[i] = ((batch->c3[i] * batch->time[i] + batch->c2[i]) * batch->time[i]
+                + batch->c1[i]) * batch->time[i] + batch->c0[i];
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+
+__attribute__((target("sse2")))
+static void evaluate_cubics_sse2(struct animation_batch *batch, SIZE_T count)
+{
+    __m128 t, v;
+    SIZE_T i;
+
+    for (i = 0; i < count; i += 4)
+    {
+        t = _mm_load_ps(&batch->time[i]);
+        v = _mm_add_ps(_mm_mul_ps(_mm_load_ps(&batch->c3[i]), t), _mm_load_ps(&batch->c2[i]));
+        v = _mm_add_ps(_mm_mul_ps(v, t), _mm_load_ps(&batch->c1[i]));
+        v = _mm_add_ps(_mm_mul_ps(v, t), _mm_load_ps(&batch->c0[i]));
+        _mm_store_ps(&batch->values[i], v);
+    }
+}
+
+__attribute__((target("avx")))
+static void evaluate_cubics_avx(struct animation_batch *batch, SIZE_T count)
+{
+    __m256 t, v;
+    SIZE_T i;
+
+    for (i = 0; i < count; i += 8)
+    {
+        t = _mm256_load_ps(&batch->time[i]);
+        v = _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(&batch->c3[i]), t), _mm256_load_ps(&batch->c2[i]));
+        v = _mm256_add_ps(_mm256_mul_ps(v, t), _mm256_load_ps(&batch->c1[i]));
+        v = _mm256_add_ps(_mm256_mul_ps(v, t), _mm256_load_ps(&batch->c0[i]));
+        _mm256_store_ps(&batch->values[i], v);
+    }
+}
+
+#endif
+
+static evaluate_cubics_func select_evaluate_cubics(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    if (IsProcessorFeaturePresent(PF_AVX_INSTRUCTIONS_AVAILABLE))
+        return evaluate_cubics_avx;
+    if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+        return evaluate_cubics_sse2;
+#endif
+    return evaluate_cubics;
+}
+
+/* Make room for count animations. The arrays are aligned and padded to a
+ * whole number of vectors, so the kernels need no tail loop. */
+static BOOL animation_batch_reserve(struct animation_batch *batch, SIZE_T count)
+{
+    SIZE_T size;
+    float *data;
+
+    count = (count + 7) & ~(SIZE_T)7;
+    if (count <= batch->size)
+        return TRUE;
+
+    size = max(64, batch->size * 2);
+    while (size < count)
+        size *= 2;
+
+    if (!(data = _aligned_malloc(6 * size * sizeof(*data), 32)))
+        return FALSE;
+    _aligned_free(batch->data);
+    batch->data = data;
+    batch->time = data;
+    batch->c0 = data + size;
+    batch->c1 = data + 2 * size;
+    batch->c2 = data + 3 * size;
+    batch->c3 = data + 4 * size;
+    batch->values = data + 5 * size;
+    batch->size = size;
+    return TRUE;
+}
+
+/* Evaluate the functions of count bindings at the given QPC time into
+ * batch->values. Empty functions evaluate to their binding's base value.
+ * Returns FALSE if out of memory; otherwise *running tells whether any
+ * value may still change after time. Compositor thread only. */
+BOOL evaluate_animations(struct animation_batch *batch, const struct animation_binding *bindings,
+        SIZE_T count, LONGLONG time, LONGLONG frequency, BOOL *running)
+{
+    static evaluate_cubics_func evaluate_vector;
+    const struct animation_segment *segment;
+    const struct animation_binding *binding;
+    double local, phase;
+    SIZE_T i, padded;
+
+    if (!animation_batch_reserve(batch, count))
+        return FALSE;
+    if (!evaluate_vector)
+        evaluate_vector = select_evaluate_cubics();
+
+    /* Gather the current segment of each function as a cubic in its local
+     * time. Other segments are folded into the constant term. */
+    *running = FALSE;
+    for (i = 0; i < count; i++)
+    {
+        binding = &bindings[i];
+        batch->time[i] = batch->c1[i] = batch->c2[i] = batch->c3[i] = 0.0f;
+        if (!binding->function->count)
+        {
+            batch->c0[i] = binding->base;
+            continue;
+        }
+
+        *running |= locate_segment(binding->function, (double)(time - binding->begin) / frequency,
+                &segment, &local);
+        switch (segment->type)
+        {
+            case ANIMATION_SEGMENT_CUBIC:
+                batch->time[i] = local;
+                batch->c0[i] = segment->coefficients[0];
+                batch->c1[i] = segment->coefficients[1];
+                batch->c2[i] = segment->coefficients[2];
+                batch->c3[i] = segment->coefficients[3];
+                break;
+
+            case ANIMATION_SEGMENT_SINUSOIDAL:
+                /* Frequency in Hz, phase in degrees. */
+                phase = 2.0 * ANIMATION_PI * segment->coefficients[2] * local
+                        + segment->coefficients[3] * (ANIMATION_PI / 180.0);
+                batch->c0[i] = segment->coefficients[0] + segment->coefficients[1] * sin(phase);
+                break;
+
+            case ANIMATION_SEGMENT_REPEAT:
+                /* Only a repeat in first place is left; it repeats nothing. */
+            case ANIMATION_SEGMENT_END:
+                batch->c0[i] = segment->coefficients[0];
+                break;
+        }
+    }
+
+    padded = (count + 7) & ~(SIZE_T)7;
+    for (; i < padded; i++)
+        batch->time[i] = batch->c0[i] = batch->c1[i] = batch->c2[i] = batch->c3[i] = 0.0f;
+    evaluate_vector(batch, padded);
+    return TRUE;
+}
+
+void animation_batch_cleanup(struct animation_batch *batch)
+{
+    _aligned_free(batch->data);
+}
@@ -0,0 +1,1201 @@
+/*
+ * Copyright 2026 Porthole contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#include <stdarg.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#define COBJMACROS
+#include "windef.h"
+#include "winbase.h"
+#include "wingdi.h"
+#include "winuser.h"
+#include "dxgi1_2.h"
+#include "d3d11.h"
+#include "d3d10.h"
+#include "dcomp_private.h"
+#include "wine/debug.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+WINE_DEFAULT_DEBUG_CHANNEL(dcomp);
+
+#ifndef PF_AVX2_INSTRUCTIONS_AVAILABLE
+#define PF_AVX2_INSTRUCTIONS_AVAILABLE 40
+#endif
+
+/* Software composition. The frame each content visual's swap chain presented
+ * last is copied to a CPU-readable staging texture and blended, in z-order,
+ * into a BGRA buffer the size of the target's client area, kept by the
+ * target, which is then shown by a window of its own, see below. Pixels are
+ * premultiplied BGRA throughout; sources in other layouts are converted one
+ * row at a time before blending.
+ *
+ * Translated content is blended row by row straight from its pixels. Any
+ * other transform is applied by mapping each target pixel back through the
+ * inverse transform and filtering the source bilinearly. */
+
+struct blend_surface
+{
+    UINT32 *bits;
+    UINT width;
+    UINT height;            /* pitch is width, top-down */
+};
+
+struct blend_layer
+{
+    const BYTE *bits;
+    UINT pitch;
+    UINT width;
+    UINT height;
+    int x;
+    int y;
+    RECT bounds;            /* target pixels the layer may cover */
+    BOOL transformed;       /* more than translated; sampled through inverse */
+    D2D_MATRIX_3X2_F inverse; /* from target to source coordinates */
+    DXGI_ALPHA_MODE alpha_mode;
+    BOOL swizzle;           /* source is RGBA rather than BGRA */
+    BYTE opacity;           /* 255 is fully opaque */
+};
+
+typedef void (*blend_row_func)(UINT32 *dst, const UINT32 *src, unsigned int count);
+
+static inline UINT32 div255(UINT32 x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+/* Premultiplied source-over: dst = src + dst * (1 - src_alpha). */
+static void blend_row_over(UINT32 *dst, const UINT32 *src, unsigned int count)
+{
+    UINT32 s, d, inv, c, out;
+    unsigned int i, shift;
+
+    for (i = 0; i < count; i++)
+    {
+        s = src[i];
+        if ((s >> 24) == 0xff)
+        {
+            dst[i] = s;
+            continue;
+        }
+        if (!(s >> 24))
+            continue;
+
+        d = dst[i];
+        inv = 255 - (s >> 24);
+        out = 0;
+        for (shift = 0; shift < 32; shift += 8)
+        {
+            c = ((s >> shift) & 0xff) + div255(((d >> shift) & 0xff) * inv);
+            out |= min(c, 0xff) << shift;
+        }
+        dst[i] = out;
+    }
+}
+
+/* Sources whose alpha is ignored replace the destination. */
+static void blend_row_copy(UINT32 *dst, const UINT32 *src, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+        dst[i] = src[i] | 0xff000000;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+
+__attribute__((target("sse2")))
+static inline __m128i blend_over_sse2(__m128i s, __m128i d)
+{
+    const __m128i zero = _mm_setzero_si128(), bias = _mm_set1_epi16(128);
+    __m128i a, inv, lo, hi;
+
+    /* Inverse source alpha of each pixel, in both 16-bit halves of its dword,
+     * then spread over the four channels of each unpacked pixel. */
+    a = _mm_srli_epi32(s, 24);
+    inv = _mm_sub_epi16(_mm_set1_epi16(255), _mm_or_si128(a, _mm_slli_epi32(a, 16)));
+
+    lo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(inv, inv));
+    hi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(inv, inv));
+    lo = _mm_add_epi16(lo, bias);
+    hi = _mm_add_epi16(hi, bias);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+    return _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+}
+
+__attribute__((target("sse2")))
+static void blend_row_over_sse2(UINT32 *dst, const UINT32 *src, unsigned int count)
+{
+    const __m128i alpha = _mm_set1_epi32(0xff000000), zero = _mm_setzero_si128();
+    unsigned int i = 0;
+    __m128i s, sa;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        s = _mm_loadu_si128((const __m128i *)&src[i]);
+        sa = _mm_and_si128(s, alpha);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, alpha)) == 0xffff)
+            _mm_storeu_si128((__m128i *)&dst[i], s);
+        else if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, zero)) != 0xffff)
+            _mm_storeu_si128((__m128i *)&dst[i],
+                    blend_over_sse2(s, _mm_loadu_si128((const __m128i *)&dst[i])));
+    }
+    blend_row_over(dst + i, src + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void blend_row_copy_sse2(UINT32 *dst, const UINT32 *src, unsigned int count)
+{
+    const __m128i alpha = _mm_set1_epi32(0xff000000);
+    unsigned int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_or_si128(_mm_loadu_si128((const __m128i *)&src[i]), alpha));
+    blend_row_copy(dst + i, src + i, count - i);
+}
+
+/* The AVX2 kernels are the SSE2 ones on 256-bit registers; unpack and pack
+ * work within 128-bit lanes, which keeps pixels in place. */
+__attribute__((target("avx2")))
+static void blend_row_over_avx2(UINT32 *dst, const UINT32 *src, unsigned int count)
+{
+    const __m256i alpha = _mm256_set1_epi32(0xff000000), zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi16(128), max = _mm256_set1_epi16(255);
+    __m256i s, d, sa, a, inv, lo, hi;
+    unsigned int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        s = _mm256_loadu_si256((const __m256i *)&src[i]);
+        sa = _mm256_and_si256(s, alpha);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, alpha)) == -1)
+        {
+            _mm256_storeu_si256((__m256i *)&dst[i], s);
+            continue;
+        }
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, zero)) == -1)
+            continue;
+
+        d = _mm256_loadu_si256((const __m256i *)&dst[i]);
+        a = _mm256_srli_epi32(s, 24);
+        inv = _mm256_sub_epi16(max, _mm256_or_si256(a, _mm256_slli_epi32(a, 16)));
+        lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi32(inv, inv));
+        hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi32(inv, inv));
+        lo = _mm256_add_epi16(lo, bias);
+        hi = _mm256_add_epi16(hi, bias);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        _mm256_storeu_si256((__m256i *)&dst[i], _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+    }
+    blend_row_over_sse2(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void blend_row_copy_avx2(UINT32 *dst, const UINT32 *src, unsigned int count)
+{
+    const __m256i alpha = _mm256_set1_epi32(0xff000000);
+    unsigned int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_si256((__m256i *)&dst[i],
+                _mm256_or_si256(_mm256_loadu_si256((const __m256i *)&src[i]), alpha));
+    blend_row_copy_sse2(dst + i, src + i, count - i);
+}
+
+#endif
+
+static void select_blend_kernels(blend_row_func *over, blend_row_func *copy)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    if (IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE))
+    {
+        *over = blend_row_over_avx2;
+        *copy = blend_row_copy_avx2;
+        return;
+    }
+    if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
+    {
+        *over = blend_row_over_sse2;
+        *copy = blend_row_copy_sse2;
+        return;
+    }
+#endif
+    *over = blend_row_over;
+    *copy = blend_row_copy;
+}
+
+static inline BOOL layer_is_opaque(const struct blend_layer *layer)
+{
+    return layer->alpha_mode == DXGI_ALPHA_MODE_IGNORE || layer->alpha_mode == DXGI_ALPHA_MODE_UNSPECIFIED;
+}
+
+/* Convert a source pixel to premultiplied BGRA with the layer opacity applied. */
+static inline UINT32 normalize_pixel(const struct blend_layer *layer, UINT32 p)
+{
+    UINT32 a, b, g, r;
+
+    if (layer->swizzle)
+        p = (p & 0xff00ff00) | ((p & 0xff) << 16) | ((p >> 16) & 0xff);
+    a = layer_is_opaque(layer) ? 0xff : p >> 24;
+    r = (p >> 16) & 0xff;
+    g = (p >> 8) & 0xff;
+    b = p & 0xff;
+    if (layer->alpha_mode == DXGI_ALPHA_MODE_STRAIGHT)
+    {
+        r = div255(r * a);
+        g = div255(g * a);
+        b = div255(b * a);
+    }
+    if (layer->opacity != 0xff)
+    {
+        a = div255(a * layer->opacity);
+        r = div255(r * layer->opacity);
+        g = div255(g * layer->opacity);
+        b = div255(b * layer->opacity);
+    }
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+/* Convert a source row to premultiplied BGRA with the layer opacity applied. */
+static const UINT32 *normalize_row(const struct blend_layer *layer, const UINT32 *src,
+        UINT32 *scratch, unsigned int count)
+{
+    unsigned int i;
+
+    if (!layer->swizzle && layer->alpha_mode != DXGI_ALPHA_MODE_STRAIGHT && layer->opacity == 0xff)
+        return src;
+
+    for (i = 0; i < count; i++)
+        scratch[i] = normalize_pixel(layer, src[i]);
+    return scratch;
+}
+
+/* A normalized source texel; outside the source everything is transparent. */
+static inline UINT32 layer_texel(const struct blend_layer *layer, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= (int)layer->width || y >= (int)layer->height)
+        return 0;
+    return normalize_pixel(layer, ((const UINT32 *)(layer->bits + y * layer->pitch))[x]);
+}
+
+/* Sample a transformed layer for the target pixels [x0, x1) of row y into
+ * dst, as normalized pixels. Texels are weighted in 1/256 steps; the
+ * transparent surroundings of the source smooth its edges. */
+static void sample_row(const struct blend_layer *layer, int x0, int x1, int y, UINT32 *dst)
+{
+    const D2D_MATRIX_3X2_F *m = &layer->inverse;
+    UINT32 t00, t01, t10, t11, w00, w01, w10, w11, out;
+    unsigned int shift;
+    int i, tx, ty, fx, fy;
+    float u, v;
+
+    /* Source position of each target pixel centre, relative to texel centres. */
+    u = m->_11 * (x0 + 0.5f) + m->_21 * (y + 0.5f) + m->_31 - 0.5f;
+    v = m->_12 * (x0 + 0.5f) + m->_22 * (y + 0.5f) + m->_32 - 0.5f;
+    for (i = 0; i < x1 - x0; i++, u += m->_11, v += m->_12)
+    {
+        if (u <= -1.0f || v <= -1.0f || u >= (float)layer->width || v >= (float)layer->height)
+        {
+            dst[i] = 0;
+            continue;
+        }
+        tx = (int)floorf(u);
+        ty = (int)floorf(v);
+        fx = (int)((u - tx) * 256.0f);
+        fy = (int)((v - ty) * 256.0f);
+
+        t00 = layer_texel(layer, tx, ty);
+        t01 = layer_texel(layer, tx + 1, ty);
+        t10 = layer_texel(layer, tx, ty + 1);
+        t11 = layer_texel(layer, tx + 1, ty + 1);
+        w00 = (256 - fx) * (256 - fy);
+        w01 = fx * (256 - fy);
+        w10 = (256 - fx) * fy;
+        w11 = fx * fy;
+
+        out = 0;
+        for (shift = 0; shift < 32; shift += 8)
+        {
+            out |= ((((t00 >> shift) & 0xff) * w00 + ((t01 >> shift) & 0xff) * w01
+                    + ((t10 >> shift) & 0xff) * w10 + ((t11 >> shift) & 0xff) * w11 + 0x8000) >> 16) << shift;
+        }
+        dst[i] = out;
+    }
+}
+
+/* Blend the part of a layer that falls within clip, which must lie within
+ * the surface. scratch must hold a row as wide as clip. */
+static void blend_layer(const struct blend_surface *dst, const struct blend_layer *layer,
+        const RECT *clip, UINT32 *scratch)
+{
+    static blend_row_func blend_over, blend_copy;
+    BOOL opaque = layer_is_opaque(layer) && layer->opacity == 0xff && !layer->transformed;
+    int x0, y0, x1, y1, y;
+    const UINT32 *src;
+
+    if (!blend_over || !blend_copy)
+        select_blend_kernels(&blend_over, &blend_copy);
+
+    x0 = max(layer->bounds.left, clip->left);
+    y0 = max(layer->bounds.top, clip->top);
+    x1 = min(layer->bounds.right, clip->right);
+    y1 = min(layer->bounds.bottom, clip->bottom);
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    for (y = y0; y < y1; y++)
+    {
+        if (layer->transformed)
+        {
+            sample_row(layer, x0, x1, y, scratch);
+            blend_over(&dst->bits[y * dst->width + x0], scratch, x1 - x0);
+            continue;
+        }
+        src = (const UINT32 *)(layer->bits + (y - layer->y) * layer->pitch) + (x0 - layer->x);
+        src = normalize_row(layer, src, scratch, x1 - x0);
+        if (opaque)
+            blend_copy(&dst->bits[y * dst->width + x0], src, x1 - x0);
+        else
+            blend_over(&dst->bits[y * dst->width + x0], src, x1 - x0);
+    }
+}
+
+/* Targets are composited in square tiles, spread over the device's worker
+ * pool. A tile's signature covers every layer overlapping it, with the swap
+ * chain's present count standing in for its pixels; tiles whose signature
+ * did not change since the last pass keep their pixels and are neither
+ * blended nor redrawn. */
+#define BLEND_TILE_SIZE 128
+
+/* A content visual as seen by one composition pass. */
+struct blend_source
+{
+    struct blend_layer layer;   /* layer.bits is set while mapped */
+    ID3D11Texture2D *buffer;    /* presented buffer, NULL if it cannot be blended */
+    ID3D11Texture2D *staging;
+    ID3D11DeviceContext *context;
+    ID3D10Multithread *multithread;
+    UINT present_count;
+    BOOL needed;                /* overlaps a tile that is redrawn */
+};
+
+struct blend_job
+{
+    struct blend_surface dst;
+    const struct blend_source *sources;
+    unsigned int source_count;
+    const unsigned int *tiles;
+    unsigned int columns;
+};
+
+static inline UINT64 hash_mix(UINT64 hash, UINT64 value)
+{
+    /* FNV-1a over whole words. */
+    return (hash ^ value) * 0x100000001b3ull;
+}
+
+static void tile_rect(const struct blend_surface *dst, unsigned int columns, unsigned int tile, RECT *rect)
+{
+    rect->left = (tile % columns) * BLEND_TILE_SIZE;
+    rect->top = (tile / columns) * BLEND_TILE_SIZE;
+    rect->right = min(rect->left + BLEND_TILE_SIZE, (LONG)dst->width);
+    rect->bottom = min(rect->top + BLEND_TILE_SIZE, (LONG)dst->height);
+}
+
+static BOOL layer_overlaps(const struct blend_layer *layer, const RECT *rect)
+{
+    return layer->bounds.left < rect->right && layer->bounds.right > rect->left
+            && layer->bounds.top < rect->bottom && layer->bounds.bottom > rect->top;
+}
+
+static inline UINT64 float_bits(float value)
+{
+    union { float f; UINT32 u; } bits = {value};
+    return bits.u;
+}
+
+static UINT64 tile_signature(const struct blend_source *sources, unsigned int count, const RECT *rect)
+{
+    UINT64 hash = 0xcbf29ce484222325ull;
+    const struct blend_layer *layer;
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        layer = &sources[i].layer;
+        if (!sources[i].buffer || !layer_overlaps(layer, rect))
+            continue;
+        hash = hash_mix(hash, i);
+        hash = hash_mix(hash, (UINT_PTR)sources[i].buffer);
+        hash = hash_mix(hash, sources[i].present_count);
+        hash = hash_mix(hash, ((UINT64)(UINT32)layer->x << 32) | (UINT32)layer->y);
+        hash = hash_mix(hash, ((UINT64)layer->width << 32) | layer->height);
+        hash = hash_mix(hash, (layer->alpha_mode << 16) | (layer->swizzle << 8) | layer->opacity);
+        if (layer->transformed)
+        {
+            hash = hash_mix(hash, (float_bits(layer->inverse._11) << 32) | float_bits(layer->inverse._12));
+            hash = hash_mix(hash, (float_bits(layer->inverse._21) << 32) | float_bits(layer->inverse._22));
+            hash = hash_mix(hash, (float_bits(layer->inverse._31) << 32) | float_bits(layer->inverse._32));
+        }
+    }
+    return hash;
+}
+
+static void blend_tile(void *context, unsigned int task)
+{
+    const struct blend_job *job = context;
+    UINT32 scratch[BLEND_TILE_SIZE];
+    unsigned int i;
+    RECT rect;
+    LONG y;
+
+    tile_rect(&job->dst, job->columns, job->tiles[task], &rect);
+    for (y = rect.top; y < rect.bottom; y++)
+        memset(&job->dst.bits[y * job->dst.width + rect.left], 0, (rect.right - rect.left) * sizeof(UINT32));
+
+    for (i = 0; i < job->source_count; i++)
+    {
+        if (job->sources[i].layer.bits)
+            blend_layer(&job->dst, &job->sources[i].layer, &rect, scratch);
+    }
+}
+
+/* The target pixels that content of the given size may cover when drawn as
+ * item. Transformed content is widened by a pixel for filtering. */
+void draw_item_bounds(const struct draw_item *item, UINT width, UINT height, RECT *rect)
+{
+    const D2D_MATRIX_3X2_F *m = &item->transform;
+    float x, y, left, top, right, bottom;
+    unsigned int i;
+
+    if (draw_item_is_translation(item))
+    {
+        SetRect(rect, (int)item->offset_x, (int)item->offset_y,
+                (int)item->offset_x + width, (int)item->offset_y + height);
+        return;
+    }
+
+    left = top = FLT_MAX;
+    right = bottom = -FLT_MAX;
+    for (i = 0; i < 4; i++)
+    {
+        x = (i & 1) ? width : 0.0f;
+        y = (i & 2) ? height : 0.0f;
+        left = min(left, x * m->_11 + y * m->_21 + m->_31);
+        right = max(right, x * m->_11 + y * m->_21 + m->_31);
+        top = min(top, x * m->_12 + y * m->_22 + m->_32);
+        bottom = max(bottom, x * m->_12 + y * m->_22 + m->_32);
+    }
+    /* Keep far-off content from overflowing the coordinates. */
+    left = min(max(left, -(float)0x40000000), (float)0x40000000);
+    top = min(max(top, -(float)0x40000000), (float)0x40000000);
+    right = min(max(right, -(float)0x40000000), (float)0x40000000);
+    bottom = min(max(bottom, -(float)0x40000000), (float)0x40000000);
+    SetRect(rect, (int)floorf(left) - 1, (int)floorf(top) - 1, (int)ceilf(right) + 1, (int)ceilf(bottom) + 1);
+}
+
+/* Invert a 3x2 transform; returns FALSE if it collapses content to a line. */
+static BOOL invert_transform(const D2D_MATRIX_3X2_F *m, D2D_MATRIX_3X2_F *inverse)
+{
+    float det = m->_11 * m->_22 - m->_12 * m->_21;
+
+    if (fabsf(det) < 1e-6f)
+        return FALSE;
+    inverse->_11 = m->_22 / det;
+    inverse->_12 = -m->_12 / det;
+    inverse->_21 = -m->_21 / det;
+    inverse->_22 = m->_11 / det;
+    inverse->_31 = -(m->_31 * inverse->_11 + m->_32 * inverse->_21);
+    inverse->_32 = -(m->_31 * inverse->_12 + m->_32 * inverse->_22);
+    return TRUE;
+}
+
+/* The buffer a swap chain presented last. Flip-model swap chains rotate
+ * their buffers on Present, so buffer 0 is always the one the application
+ * draws the next frame into and the highest one holds the frame it last
+ * presented. Other swap chains keep no presented frame that can be read. */
+static HRESULT get_presented_buffer(IDXGISwapChain1 *swapchain, DXGI_SWAP_CHAIN_DESC1 *desc,
+        ID3D11Texture2D **buffer)
+{
+    HRESULT hr;
+
+    if (FAILED(hr = IDXGISwapChain1_GetDesc1(swapchain, desc)))
+        return hr;
+    if ((desc->SwapEffect != DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL && desc->SwapEffect != DXGI_SWAP_EFFECT_FLIP_DISCARD)
+            || desc->BufferCount < 2)
+        return DXGI_ERROR_UNSUPPORTED;
+    return IDXGISwapChain1_GetBuffer(swapchain, desc->BufferCount - 1, &IID_ID3D11Texture2D, (void **)buffer);
+}
+
+/* Describe one content visual's swap chain without reading its pixels. */
+static void describe_source(const struct composite_snapshot *work, struct blend_source *source)
+{
+    DXGI_SWAP_CHAIN_DESC1 desc1;
+    IDXGISwapChain1 *swapchain;
+    D3D11_TEXTURE2D_DESC desc;
+    ID3D11Texture2D *buffer;
+    HRESULT hr;
+
+    memset(source, 0, sizeof(*source));
+
+    if (FAILED(hr = IUnknown_QueryInterface(work->item.content, &IID_IDXGISwapChain1, (void **)&swapchain)))
+    {
+        FIXME("Visual content %p is not an IDXGISwapChain1, hr %#lx\n", work->item.content, hr);
+        return;
+    }
+    hr = get_presented_buffer(swapchain, &desc1, &buffer);
+    /* Without a present count the content is assumed to change every pass. */
+    if (SUCCEEDED(hr) && FAILED(IDXGISwapChain1_GetLastPresentCount(swapchain, &source->present_count)))
+        source->present_count = GetTickCount();
+    IDXGISwapChain1_Release(swapchain);
+    if (FAILED(hr))
+    {
+        WARN("Failed to get the presented buffer of swap chain %p, hr %#lx\n", work->item.content, hr);
+        return;
+    }
+    if (!source->present_count)
+    {
+        TRACE("Swap chain %p has not presented yet.\n", work->item.content);
+        ID3D11Texture2D_Release(buffer);
+        return;
+    }
+
+    ID3D11Texture2D_GetDesc(buffer, &desc);
+    if ((desc.Format != DXGI_FORMAT_B8G8R8A8_UNORM && desc.Format != DXGI_FORMAT_B8G8R8A8_UNORM_SRGB
+            && desc.Format != DXGI_FORMAT_R8G8B8A8_UNORM && desc.Format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB)
+            || desc.SampleDesc.Count != 1)
+    {
+        FIXME("Unsupported back buffer format %#x, %u samples\n", desc.Format, desc.SampleDesc.Count);
+        ID3D11Texture2D_Release(buffer);
+        return;
+    }
+
+    source->layer.transformed = !draw_item_is_translation(&work->item);
+    if (source->layer.transformed && !invert_transform(&work->item.transform, &source->layer.inverse))
+    {
+        TRACE("Content %p is transformed to nothing.\n", work->item.content);
+        ID3D11Texture2D_Release(buffer);
+        return;
+    }
+
+    source->buffer = buffer;
+    source->layer.width = desc.Width;
+    source->layer.height = desc.Height;
+    source->layer.x = (int)work->item.offset_x;
+    source->layer.y = (int)work->item.offset_y;
+    draw_item_bounds(&work->item, desc.Width, desc.Height, &source->layer.bounds);
+    source->layer.alpha_mode = desc1.AlphaMode;
+    source->layer.swizzle = desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM || desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+    source->layer.opacity = (BYTE)(min(max(work->item.opacity, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static BOOL staging_matches(ID3D11Texture2D *staging, ID3D11Device *device, const D3D11_TEXTURE2D_DESC *desc)
+{
+    D3D11_TEXTURE2D_DESC staging_desc;
+    ID3D11Device *staging_device;
+
+    ID3D11Texture2D_GetDevice(staging, &staging_device);
+    ID3D11Device_Release(staging_device);
+    if (staging_device != device)
+        return FALSE;
+
+    ID3D11Texture2D_GetDesc(staging, &staging_desc);
+    return staging_desc.Width == desc->Width && staging_desc.Height == desc->Height
+            && staging_desc.Format == desc->Format;
+}
+
+/* The staging texture cached for a target's index-th content visual. */
+static ID3D11Texture2D **target_staging(struct composition_target *target, unsigned int index)
+{
+    if (index >= target->blend_staging_count)
+    {
+        if (!dcomp_array_reserve((void **)&target->blend_staging, &target->blend_staging_size,
+                index + 1, sizeof(*target->blend_staging)))
+            return NULL;
+        memset(&target->blend_staging[target->blend_staging_count], 0,
+                (index + 1 - target->blend_staging_count) * sizeof(*target->blend_staging));
+        target->blend_staging_count = index + 1;
+    }
+    return &target->blend_staging[index];
+}
+
+/* Content is read back through the application's immediate context from a
+ * worker, which is only safe while its device serialises the context with
+ * ID3D10Multithread, and only the frame the swap chain presented last may
+ * be read. Path selection leaves other content to overlays. */
+BOOL blend_content_readable(IUnknown *content)
+{
+    ID3D10Multithread *multithread;
+    DXGI_SWAP_CHAIN_DESC1 desc;
+    IDXGISwapChain1 *swapchain;
+    ID3D11Device *d3d_device;
+    ID3D11Texture2D *buffer;
+    BOOL readable = FALSE;
+
+    if (FAILED(IUnknown_QueryInterface(content, &IID_IDXGISwapChain1, (void **)&swapchain)))
+        return FALSE;
+    if (SUCCEEDED(get_presented_buffer(swapchain, &desc, &buffer)))
+    {
+        ID3D11Texture2D_GetDevice(buffer, &d3d_device);
+        if (SUCCEEDED(ID3D11Device_QueryInterface(d3d_device, &IID_ID3D10Multithread, (void **)&multithread)))
+        {
+            readable = ID3D10Multithread_GetMultithreadProtected(multithread);
+            ID3D10Multithread_Release(multithread);
+        }
+        ID3D11Device_Release(d3d_device);
+        ID3D11Texture2D_Release(buffer);
+    }
+    IDXGISwapChain1_Release(swapchain);
+    return readable;
+}
+
+/* Copy a source's presented buffer into a staging texture cached per
+ * content visual and map it for the tiles to read. */
+static void map_source(const struct composite_snapshot *work, struct blend_source *source)
+{
+    D3D11_TEXTURE2D_DESC desc, presented_desc;
+    ID3D11Texture2D **staging, *presented;
+    D3D11_MAPPED_SUBRESOURCE map;
+    DXGI_SWAP_CHAIN_DESC1 desc1;
+    IDXGISwapChain1 *swapchain;
+    ID3D11Device *d3d_device;
+    HRESULT hr;
+
+    if (!(staging = target_staging(work->target, work->index)))
+        return;
+
+    ID3D11Texture2D_GetDesc(source->buffer, &desc);
+    ID3D11Texture2D_GetDevice(source->buffer, &d3d_device);
+    if (*staging && !staging_matches(*staging, d3d_device, &desc))
+    {
+        ID3D11Texture2D_Release(*staging);
+        *staging = NULL;
+    }
+    if (!*staging)
+    {
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        desc.MiscFlags = 0;
+        if (FAILED(hr = ID3D11Device_CreateTexture2D(d3d_device, &desc, NULL, staging)))
+        {
+            ERR("Failed to create staging texture, hr %#lx\n", hr);
+            *staging = NULL;
+            ID3D11Device_Release(d3d_device);
+            return;
+        }
+    }
+    source->staging = *staging;
+
+    /* The application renders on its own threads with the same immediate
+     * context. Path selection only blends content whose device serialises
+     * its context, but the application may have turned that off since. */
+    if (FAILED(ID3D11Device_QueryInterface(d3d_device, &IID_ID3D10Multithread, (void **)&source->multithread)))
+        source->multithread = NULL;
+    if (!source->multithread || !ID3D10Multithread_GetMultithreadProtected(source->multithread))
+    {
+        WARN("Device %p of content %p is not multithread protected, not blending it.\n",
+                d3d_device, work->item.content);
+        ID3D11Device_Release(d3d_device);
+        return;
+    }
+    ID3D11Device_GetImmediateContext(d3d_device, &source->context);
+    ID3D11Device_Release(d3d_device);
+
+    /* Present rotates the buffers through the same context, so the buffer
+     * presented last stays put while the context is held. The application
+     * may have presented since the source was described, though, making
+     * that buffer the one it draws next, so look the buffer up again. */
+    ID3D10Multithread_Enter(source->multithread);
+    if (SUCCEEDED(hr = IUnknown_QueryInterface(work->item.content, &IID_IDXGISwapChain1, (void **)&swapchain)))
+    {
+        if (SUCCEEDED(hr = get_presented_buffer(swapchain, &desc1, &presented)))
+        {
+            ID3D11Texture2D_GetDesc(presented, &presented_desc);
+            if (presented_desc.Width != desc.Width || presented_desc.Height != desc.Height
+                    || presented_desc.Format != desc.Format)
+            {
+                TRACE("Content %p was resized since it was described.\n", work->item.content);
+                ID3D11Texture2D_Release(presented);
+                hr = S_FALSE;
+            }
+            else
+            {
+                ID3D11Texture2D_Release(source->buffer);
+                source->buffer = presented;
+            }
+        }
+        IDXGISwapChain1_Release(swapchain);
+    }
+    if (hr == S_OK)
+    {
+        ID3D11DeviceContext_CopyResource(source->context, (ID3D11Resource *)source->staging,
+                (ID3D11Resource *)source->buffer);
+        hr = ID3D11DeviceContext_Map(source->context, (ID3D11Resource *)source->staging, 0, D3D11_MAP_READ, 0, &map);
+    }
+    ID3D10Multithread_Leave(source->multithread);
+
+    if (hr != S_OK)
+    {
+        if (FAILED(hr))
+            WARN("Failed to read back content %p, hr %#lx\n", work->item.content, hr);
+        return;
+    }
+    source->layer.bits = map.pData;
+    source->layer.pitch = map.RowPitch;
+}
+
+static void release_source(struct blend_source *source)
+{
+    if (source->layer.bits)
+    {
+        ID3D10Multithread_Enter(source->multithread);
+        ID3D11DeviceContext_Unmap(source->context, (ID3D11Resource *)source->staging, 0);
+        ID3D10Multithread_Leave(source->multithread);
+    }
+    if (source->multithread)
+        ID3D10Multithread_Release(source->multithread);
+    if (source->context)
+        ID3D11DeviceContext_Release(source->context);
+    if (source->buffer)
+        ID3D11Texture2D_Release(source->buffer);
+}
+
+/* Make the target's buffer match its client area. Returns FALSE on failure;
+ * *resized is set if every tile has to be redrawn. */
+static BOOL resize_target_buffer(struct composition_target *target, UINT width, UINT height,
+        unsigned int tile_count, BOOL *resized)
+{
+    if (target->blend_width == width && target->blend_height == height)
+        return TRUE;
+    *resized = TRUE;
+
+    if (!dcomp_array_reserve((void **)&target->blend_bits, &target->blend_bits_size,
+            (SIZE_T)width * height, sizeof(*target->blend_bits))
+            || !dcomp_array_reserve((void **)&target->tile_hashes, &target->tile_hashes_size,
+            tile_count, sizeof(*target->tile_hashes))
+            || !dcomp_array_reserve((void **)&target->dirty_tiles, &target->dirty_tiles_size,
+            tile_count, sizeof(*target->dirty_tiles)))
+    {
+        ERR("Failed to allocate a %ux%u composition buffer.\n", width, height);
+        target->blend_width = target->blend_height = 0;
+        return FALSE;
+    }
+    target->blend_width = width;
+    target->blend_height = height;
+    return TRUE;
+}
+
+/* The blended result is shown by a window of its own: a child of the target
+ * at the bottom of its z-order, so that overlay planes and the application's
+ * own child windows stay above it. Neither the compositor nor the workers
+ * ever draw into a window of the application, and the application painting
+ * its window does not wipe the result out.
+ *
+ * The window belongs to the thread owning the target window, which creates
+ * it from a placement, see window.c. It paints itself from a copy of the
+ * result that the workers update under the lock; everything else is posted
+ * to it, so no thread waits on its owner. */
+
+#define WM_DCOMP_BLEND_UPDATE   (WM_USER + 0)
+#define WM_DCOMP_BLEND_DESTROY  (WM_USER + 1)
+
+static const WCHAR blend_window_class[] = L"__wine_dcomp_blend";
+
+struct blend_window
+{
+    LONG ref;               /* one for the target, one for the window, one per queued creation */
+    SRWLOCK lock;
+    HWND hwnd;              /* under lock */
+    BOOL creating;          /* a placement creating the window is queued, under lock */
+    BOOL dead;              /* the target is gone, under lock */
+    BOOL visible;           /* under lock */
+    LONG update_pending;    /* an update message is queued */
+    UINT32 *bits;           /* what the window shows, under lock */
+    SIZE_T bits_size;
+    UINT width;
+    UINT height;
+    RECT dirty;             /* to repaint on the next update, under lock */
+};
+
+static void blend_window_release(struct blend_window *window)
+{
+    if (!InterlockedDecrement(&window->ref))
+    {
+        free(window->bits);
+        free(window);
+    }
+}
+
+/* Have the window pick up its new state. Called with the lock held. */
+static void blend_window_post_update(struct blend_window *window)
+{
+    if (!window->hwnd || InterlockedExchange(&window->update_pending, TRUE))
+        return;
+    if (!PostMessageW(window->hwnd, WM_DCOMP_BLEND_UPDATE, 0, 0))
+    {
+        WARN("Failed to update blend window %p, error %lu.\n", window->hwnd, GetLastError());
+        InterlockedExchange(&window->update_pending, FALSE);
+    }
+}
+
+static void blend_window_paint(HWND hwnd, struct blend_window *window)
+{
+    BITMAPINFO info = {{0}};
+    PAINTSTRUCT ps;
+    RECT rect;
+    HDC hdc;
+
+    if (!(hdc = BeginPaint(hwnd, &ps)))
+        return;
+
+    info.bmiHeader.biSize = sizeof(info.bmiHeader);
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+
+    AcquireSRWLockShared(&window->lock);
+    SetRect(&rect, 0, 0, window->width, window->height);
+    if (IntersectRect(&rect, &rect, &ps.rcPaint))
+    {
+        info.bmiHeader.biWidth = window->width;
+        info.bmiHeader.biHeight = -(LONG)window->height;
+        SetDIBitsToDevice(hdc, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top,
+                rect.left, rect.top, 0, window->height, window->bits, &info, DIB_RGB_COLORS);
+    }
+    ReleaseSRWLockShared(&window->lock);
+
+    EndPaint(hwnd, &ps);
+}
+
+static void blend_window_update(HWND hwnd, struct blend_window *window)
+{
+    UINT width, height;
+    RECT rect, dirty;
+    BOOL show;
+
+    InterlockedExchange(&window->update_pending, FALSE);
+
+    AcquireSRWLockExclusive(&window->lock);
+    width = window->width;
+    height = window->height;
+    show = window->visible && width && height;
+    dirty = window->dirty;
+    SetRectEmpty(&window->dirty);
+    ReleaseSRWLockExclusive(&window->lock);
+
+    GetClientRect(hwnd, &rect);
+    if (rect.right != (LONG)width || rect.bottom != (LONG)height
+            || !show != !(GetWindowLongW(hwnd, GWL_STYLE) & WS_VISIBLE))
+    {
+        TRACE("%s blend window %p at %ux%u\n", show ? "showing" : "hiding", hwnd, width, height);
+        SetWindowPos(hwnd, HWND_BOTTOM, 0, 0, width, height,
+                SWP_NOACTIVATE | (show ? SWP_SHOWWINDOW : SWP_HIDEWINDOW));
+    }
+    if (show)
+        InvalidateRect(hwnd, &dirty, FALSE);
+}
+
+static LRESULT CALLBACK blend_window_proc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
+{
+    struct blend_window *window = (struct blend_window *)GetWindowLongPtrW(hwnd, 0);
+
+    switch (msg)
+    {
+        case WM_NCCREATE:
+            window = ((CREATESTRUCTW *)lparam)->lpCreateParams;
+            InterlockedIncrement(&window->ref);
+            SetWindowLongPtrW(hwnd, 0, (LONG_PTR)window);
+            break;
+
+        case WM_NCHITTEST:
+            /* Input goes to the target as if the result were drawn into it. */
+            return HTTRANSPARENT;
+
+        case WM_ERASEBKGND:
+            return 1;
+
+        case WM_PAINT:
+            if (!window)
+                break;
+            blend_window_paint(hwnd, window);
+            return 0;
+
+        case WM_DCOMP_BLEND_UPDATE:
+            blend_window_update(hwnd, window);
+            return 0;
+
+        case WM_DCOMP_BLEND_DESTROY:
+            DestroyWindow(hwnd);
+            return 0;
+
+        case WM_NCDESTROY:
+            if (!window)
+                break;
+            AcquireSRWLockExclusive(&window->lock);
+            if (window->hwnd == hwnd)
+                window->hwnd = NULL;
+            ReleaseSRWLockExclusive(&window->lock);
+            SetWindowLongPtrW(hwnd, 0, 0);
+            blend_window_release(window);
+            break;
+    }
+
+    return DefWindowProcW(hwnd, msg, wparam, lparam);
+}
+
+/* Show or hide the window showing a target's blended result, and have it
+ * created on the target's thread if there is none. Compositor thread only. */
+void blend_window_show(struct composition_device *device, struct composition_target *target, BOOL show)
+{
+    struct blend_window *window = target->blend_window;
+    struct window_placement placement = {0};
+    BOOL create;
+
+    if (!window)
+    {
+        if (!show)
+            return;
+        if (!(window = calloc(1, sizeof(*window))))
+        {
+            ERR("Failed to allocate the blend window of target %p.\n", target);
+            return;
+        }
+        window->ref = 1;
+        InitializeSRWLock(&window->lock);
+        target->blend_window = window;
+    }
+
+    AcquireSRWLockExclusive(&window->lock);
+    if (window->visible != show)
+    {
+        window->visible = show;
+        blend_window_post_update(window);
+    }
+    if ((create = show && !window->hwnd && !window->creating))
+        window->creating = TRUE;
+    ReleaseSRWLockExclusive(&window->lock);
+
+    if (!create)
+        return;
+
+    placement.hwnd = target->hwnd;
+    placement.blend_window = window;
+    InterlockedIncrement(&window->ref);
+    if (!queue_window_placement(device, &placement))
+        blend_window_placement_lost(&placement);
+}
+
+/* Create the window for a placement queued by blend_window_show(). Runs on
+ * the thread owning the target window. */
+void blend_window_create(const struct window_placement *placement)
+{
+    struct blend_window *window = placement->blend_window;
+    static HINSTANCE instance;
+    static ATOM class_atom;
+    WNDCLASSW class = {0};
+    HWND hwnd = NULL;
+
+    if (!class_atom)
+    {
+        GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                (const WCHAR *)blend_window_proc, &instance);
+        class.lpfnWndProc = blend_window_proc;
+        class.cbWndExtra = sizeof(window);
+        class.hInstance = instance;
+        class.lpszClassName = blend_window_class;
+        if (!(class_atom = RegisterClassW(&class)) && GetLastError() == ERROR_CLASS_ALREADY_EXISTS)
+            class_atom = 1;
+    }
+
+    /* Hidden and empty until the first update. */
+    if (class_atom)
+        hwnd = CreateWindowExW(WS_EX_NOPARENTNOTIFY, blend_window_class, NULL, WS_CHILD | WS_DISABLED,
+                0, 0, 0, 0, placement->hwnd, NULL, instance, window);
+    if (!hwnd)
+        WARN("Failed to create a blend window in hwnd %p, error %lu.\n", placement->hwnd, GetLastError());
+
+    AcquireSRWLockExclusive(&window->lock);
+    window->creating = FALSE;
+    if (hwnd && window->dead)
+    {
+        ReleaseSRWLockExclusive(&window->lock);
+        DestroyWindow(hwnd);
+    }
+    else
+    {
+        if (hwnd)
+        {
+            TRACE("created blend window %p in hwnd %p\n", hwnd, placement->hwnd);
+            window->hwnd = hwnd;
+            SetRect(&window->dirty, 0, 0, window->width, window->height);
+            blend_window_post_update(window);
+        }
+        ReleaseSRWLockExclusive(&window->lock);
+    }
+    blend_window_release(window);
+}
+
+/* A creation placement that was never handed to the target's thread; the
+ * next pass blending the target queues another one. */
+void blend_window_placement_lost(const struct window_placement *placement)
+{
+    struct blend_window *window = placement->blend_window;
+
+    AcquireSRWLockExclusive(&window->lock);
+    window->creating = FALSE;
+    ReleaseSRWLockExclusive(&window->lock);
+    blend_window_release(window);
+}
+
+/* Called when the target is freed. The window is destroyed by its owner. */
+void blend_window_destroy(struct blend_window *window)
+{
+    HWND hwnd;
+
+    if (!window)
+        return;
+
+    AcquireSRWLockExclusive(&window->lock);
+    window->dead = TRUE;
+    hwnd = window->hwnd;
+    ReleaseSRWLockExclusive(&window->lock);
+
+    if (hwnd && !PostMessageW(hwnd, WM_DCOMP_BLEND_DESTROY, 0, 0))
+        WARN("Failed to destroy blend window %p, error %lu.\n", hwnd, GetLastError());
+    blend_window_release(window);
+}
+
+/* Hand the changed part of a target's result to its window. Called on a
+ * worker; returns FALSE if the window could not take it. */
+static BOOL blend_window_present(struct blend_window *window, const struct blend_surface *dst, const RECT *rect)
+{
+    RECT copy = *rect;
+    int y;
+
+    AcquireSRWLockExclusive(&window->lock);
+    if (window->width != dst->width || window->height != dst->height)
+    {
+        if (!dcomp_array_reserve((void **)&window->bits, &window->bits_size,
+                (SIZE_T)dst->width * dst->height, sizeof(*window->bits)))
+        {
+            ReleaseSRWLockExclusive(&window->lock);
+            ERR("Failed to allocate a %ux%u blend window buffer.\n", dst->width, dst->height);
+            return FALSE;
+        }
+        window->width = dst->width;
+        window->height = dst->height;
+        SetRect(&copy, 0, 0, dst->width, dst->height);
+    }
+    for (y = copy.top; y < copy.bottom; y++)
+        memcpy(&window->bits[(SIZE_T)y * dst->width + copy.left], &dst->bits[(SIZE_T)y * dst->width + copy.left],
+                (copy.right - copy.left) * sizeof(*dst->bits));
+    UnionRect(&window->dirty, &window->dirty, &copy);
+    blend_window_post_update(window);
+    ReleaseSRWLockExclusive(&window->lock);
+    return TRUE;
+}
+
+/* Blend every content visual of one target, bottom-most first, into a
+ * buffer the size of its client area, width by height, and hand the changed
+ * part to the target's blend window. entries are the target's contiguous
+ * run of frame entries. Called on a worker, one run per target at a time;
+ * the tiles are blended on the other workers. If reset is set, every tile is
+ * redrawn. Returns TRUE if anything was redrawn. */
+BOOL blend_target(struct composition_device *device, const struct composite_snapshot *entries, unsigned int count,
+        UINT width, UINT height, BOOL reset)
+{
+    struct composition_target *target = entries[0].target;
+    unsigned int i, tile, rows, tile_count, dirty_count = 0;
+    struct blend_source *sources;
+    struct blend_job job;
+    BOOL resized = reset;
+    RECT rect, bounds;
+    UINT64 hash;
+
+    job.dst.width = width;
+    job.dst.height = height;
+    if (!job.dst.width || !job.dst.height || !target->blend_window)
+        return FALSE;
+
+    job.columns = (job.dst.width + BLEND_TILE_SIZE - 1) / BLEND_TILE_SIZE;
+    rows = (job.dst.height + BLEND_TILE_SIZE - 1) / BLEND_TILE_SIZE;
+    tile_count = job.columns * rows;
+    if (!resize_target_buffer(target, job.dst.width, job.dst.height, tile_count, &resized)
+            || !dcomp_array_reserve((void **)&target->blend_sources, &target->blend_sources_size,
+            count, sizeof(*target->blend_sources)))
+        return FALSE;
+    job.dst.bits = target->blend_bits;
+    sources = target->blend_sources;
+
+    for (i = 0; i < count; i++)
+        describe_source(&entries[i], &sources[i]);
+
+    SetRectEmpty(&bounds);
+    for (tile = 0; tile < tile_count; tile++)
+    {
+        tile_rect(&job.dst, job.columns, tile, &rect);
+        hash = tile_signature(sources, count, &rect);
+        if (!resized && hash == target->tile_hashes[tile])
+            continue;
+
+        target->tile_hashes[tile] = hash;
+        target->dirty_tiles[dirty_count++] = tile;
+        UnionRect(&bounds, &bounds, &rect);
+        for (i = 0; i < count; i++)
+        {
+            if (sources[i].buffer && layer_overlaps(&sources[i].layer, &rect))
+                sources[i].needed = TRUE;
+        }
+    }
+
+    if (dirty_count)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (sources[i].needed)
+                map_source(&entries[i], &sources[i]);
+        }
+
+        job.sources = sources;
+        job.source_count = count;
+        job.tiles = target->dirty_tiles;
+        worker_pool_run(&device->workers, blend_tile, &job, dirty_count);
+    }
+
+    for (i = 0; i < count; i++)
+        release_source(&sources[i]);
+
+    if (!dirty_count)
+        return FALSE;
+
+    /* Whatever the window missed is redrawn in full next time. */
+    if (!blend_window_present(target->blend_window, &job.dst, &bounds))
+        target->blend_width = target->blend_height = 0;
+    TRACE("blended %u of %u tile(s) from %u layer(s) into %ux%u target hwnd %p\n", dirty_count, tile_count,
+            count, job.dst.width, job.dst.height, target->hwnd);
+    return TRUE;
+}
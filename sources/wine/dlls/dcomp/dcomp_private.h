@@ -20,23 +20,273 @@
 #define __WINE_DCOMP_PRIVATE_H
 
 #include "dcomp.h"
+#include "d3d11.h"
 #include "wine/list.h"
+#include "wine/rbtree.h"
+
+#ifndef DCOMPOSITION_ERROR_WINDOW_ALREADY_COMPOSED
+#define DCOMPOSITION_ERROR_WINDOW_ALREADY_COMPOSED ((HRESULT)0x88980800)
+#endif
 
 /* IDCompositionDevice3 is not in the CX26 IDL, define manually */
 DEFINE_GUID(IID_IDCompositionDevice3, 0x0987cb06, 0xf916, 0x48bf, 0x8d,0x35, 0xce,0x76,0x41,0x78,0x1b,0xd9);
 
+struct animation_function;
+struct blend_source;
+struct blend_window;
+struct overlay_candidate;
+struct composition_frame;
+struct composition_transform;
+struct composition_visual;
+
+#define WORKER_MAX_THREADS 15
+
+typedef void (*worker_task_func)(void *context, unsigned int task);
+
+/* Tasks [next, end) of a batch, claimed first by one thread, see workers.c. */
+struct worker_slice
+{
+    LONG next;
+    LONG end;
+};
+
+struct worker_batch
+{
+    worker_task_func func;
+    void *context;
+    void (*complete)(struct worker_batch *batch); /* for batches run without waiting */
+    struct list entry;      /* in worker_pool.batches while tasks are left to claim */
+    BOOL queued;
+    unsigned int users;     /* threads working on the batch, under the pool lock */
+    unsigned int remaining; /* tasks not finished yet, under the pool lock */
+    unsigned int slice_count;
+    struct worker_slice slices[WORKER_MAX_THREADS + 1];
+};
+
+struct worker_pool
+{
+    SRWLOCK lock;
+    CONDITION_VARIABLE work_cv; /* a batch was queued, or the pool is stopping */
+    CONDITION_VARIABLE done_cv; /* a thread left a batch */
+    struct list batches;
+    BOOL stop;
+    HANDLE threads[WORKER_MAX_THREADS];
+    unsigned int thread_count;
+};
+
+/* The 2x2 linear part of a 3x2 transform, whose translation is kept apart. */
+struct visual_linear
+{
+    float _11, _12;
+    float _21, _22;
+};
+
+/* Per-device structure-of-arrays storage for visual properties, indexed by
+ * composition_visual.slot, see properties.c. Under the device lock. */
+struct visual_properties
+{
+    struct composition_visual **visuals;
+    UINT32 *parent;         /* slot of the parent visual, 0 for none */
+    float *offset_x;
+    float *offset_y;
+    float *transform_x;     /* translation of the visual's transform */
+    float *transform_y;
+    struct visual_linear *linear;       /* rest of the visual's transform */
+    float *world_x;         /* translation of the transform from the root */
+    float *world_y;
+    struct visual_linear *world_linear; /* rest of it, kept while linear_count */
+    UINT32 *levels;         /* first slot of each depth level, then the end */
+    struct composition_visual **order; /* scratch for re-sorting */
+    SIZE_T level_count;
+    SIZE_T count;
+    SIZE_T size;
+    SIZE_T linear_count;    /* visuals whose transform is more than a translation */
+    SIZE_T dirty_level;     /* first level to re-evaluate, level_count if none */
+    BOOL order_dirty;       /* tree structure changed */
+    BOOL world_dirty;       /* an offset or transform changed */
+};
+
+/* Scratch for evaluating a frame's animations, see animation.c: parallel
+ * arrays of each animation's time within its current segment, the
+ * segment's cubic coefficients and the resulting value. */
+struct animation_batch
+{
+    float *data;            /* holds all of the arrays below */
+    float *time;
+    float *c0;
+    float *c1;
+    float *c2;
+    float *c3;
+    float *values;
+    SIZE_T size;
+};
+
+/* An animated value in a frame, a visual offset or a transform parameter;
+ * see bind_animations() for what the compositor does with it. */
+struct animation_binding
+{
+    struct animation_function *function; /* referenced, released with the frame */
+    LONGLONG begin;         /* QPC time at which the function starts */
+    float base;             /* value the entries were compiled with */
+};
+
+/* Fixed-size object pool, see pool.c. */
+struct object_pool
+{
+    SLIST_HEADER free_list;
+    SRWLOCK lock;           /* serialises growth */
+    struct list slabs;
+    SIZE_T object_size;
+    unsigned int objects_per_slab;
+};
+
+/* A window operation gathered by the compositor during a pass. It is carried
+ * out on the thread that owns the window, see window.c. */
+struct window_placement
+{
+    HWND hwnd;
+    HWND parent;
+    DWORD tid;          /* owning thread of hwnd, filled in when queued */
+    SIZE_T order;       /* queue position, filled in when queued */
+    BOOL reparent;      /* SetParent(hwnd, parent) first */
+    BOOL retire;        /* hide the window before reparenting, and leave it hidden */
+    struct blend_window *blend_window; /* only create its window as a child of hwnd, see blend.c */
+    LONG style;         /* new GWL_STYLE, or 0 to leave it unchanged */
+    int x, y, width, height;
+    UINT flags;
+    struct composition_target *target; /* whose plane this places, or NULL */
+    unsigned int plane;                /* index of that plane */
+};
+
+/* How a device composites, from WINE_DCOMP_COMPOSITOR. */
+enum composition_mode
+{
+    COMPOSITION_MODE_ADAPTIVE,  /* overlays where possible, blending where needed */
+    COMPOSITION_MODE_OVERLAY,
+    COMPOSITION_MODE_BLEND,
+};
+
+/* How a target was composited in the last pass. */
+enum composition_path
+{
+    COMPOSITION_PATH_NONE,
+    COMPOSITION_PATH_OVERLAY,   /* every content visual is a plane */
+    COMPOSITION_PATH_BLEND,     /* every content visual is blended */
+    COMPOSITION_PATH_MIXED,     /* the bottom-most ones are blended, the rest are planes */
+};
+
 struct composition_device
 {
     IDCompositionDevice IDCompositionDevice_iface;
     IDCompositionDesktopDevice IDCompositionDesktopDevice_iface;
     CRITICAL_SECTION cs;
-    struct list targets;
-    HANDLE thread;
-    BOOL thread_exited;
+    /* Targets, all under cs. target_tree holds every target keyed by HWND;
+     * active_targets only those whose tree currently has content, and
+     * dirty_targets those whose tree changed since the last Commit. */
+    struct wine_rb_tree target_tree;
+    struct list active_targets;
+    unsigned int active_count;
+    struct list dirty_targets;
+    HANDLE thread;          /* long-lived compositor thread, joined in Release */
+    HANDLE commit_event;    /* auto-reset, signalled by Commit to wake the compositor */
+    BOOL thread_stop;
+    struct composition_frame *pending_frame;  /* published by Commit, taken by the compositor */
+    UINT64 commit_seq;      /* sequence number of the last Commit, under cs */
+    UINT64 retired_seq;     /* last sequence number applied by the compositor, under fence_lock */
+    UINT64 coalesced_commits; /* commits merged into a later pass, under fence_lock */
+    UINT64 taken_seq;       /* sequence number of the last frame taken, compositor thread only */
+    UINT64 pass_seq;        /* last composition pass, compositor thread only */
+    /* The last committed frame with animations, as committed, while any of
+     * them runs, and scratch for evaluating them; compositor thread only. */
+    struct composition_frame *animation_frame;
+    struct animation_batch animation_batch;
+    D2D_MATRIX_3X2_F *animation_worlds; /* world transform of each animated visual */
+    SIZE_T animation_worlds_size;
+    struct window_placement *placements; /* gathered per pass, compositor thread only */
+    /* Targets that have overlay planes, each holding an internal reference,
+     * and scratch for updating them; compositor thread only. */
+    struct list overlay_targets;
+    struct composition_target_placement *overlay_planes;
+    SIZE_T overlay_planes_size;
+    struct overlay_candidate *overlay_candidates;
+    SIZE_T overlay_candidates_size;
+    SIZE_T placements_size;
+    SIZE_T placement_count;
+    struct list transform_visuals; /* visuals whose transform object changed, under cs */
+    struct list animated_visuals;  /* visuals with an offset animation, under cs */
+    struct list animated_transforms; /* transforms with an animated parameter, under cs */
+    struct composition_visual **visit_stack; /* scratch for tree walks, under cs */
+    SIZE_T visit_stack_size;
+    /* Visual and transform property changes, pushed by API threads without
+     * taking cs and applied to the staged objects under cs by the next Commit.
+     * Applied records are recycled through free_commands. */
+    SLIST_HEADER commands;
+    SLIST_HEADER free_commands;
+    /* Storage for this device's visuals and targets. Every object holds a
+     * device reference, so the pools outlive them. */
+    struct object_pool visual_pool;
+    struct object_pool target_pool;
+    struct visual_properties props;
+    enum composition_mode mode;
+    /* Blending, see blend.c, runs on the workers, started on first use by
+     * the compositor thread. */
+    struct worker_pool workers;
+    BOOL workers_started;
+    SRWLOCK compose_lock;   /* guards inflight_frames and the targets' runs */
+    struct list inflight_frames; /* frames being blended, oldest first */
+    struct composition_target **start_targets; /* scratch, compositor thread only */
+    SIZE_T start_targets_size;
+    SRWLOCK fence_lock;
+    CONDITION_VARIABLE fence_cv;
+    /* Composition frame clock, in QueryPerformanceCounter ticks. Frames are
+     * spaced frame_period apart starting at frame_epoch, which the compositor
+     * moves to the time of each composition pass. */
+    SRWLOCK clock_lock;
+    LONGLONG frame_epoch;
+    LONGLONG frame_period;
+    LONGLONG qpc_frequency;
+    DXGI_RATIONAL composition_rate;
     int version;
     LONG ref;
 };
 
+/* One entry of a target's draw list: a content visual with the properties it
+ * inherits from its ancestors accumulated, in draw order. */
+struct draw_item
+{
+    IUnknown *content;
+    float offset_x;         /* translation of transform */
+    float offset_y;
+    D2D_MATRIX_3X2_F transform; /* from content to target coordinates */
+    D2D_RECT_F clip;
+    float opacity;
+};
+
+/* A target's contiguous run of entries in a frame. */
+struct target_run
+{
+    struct composition_frame *frame;
+    unsigned int start;
+    unsigned int count;
+    UINT width, height;     /* client area of the target */
+    BOOL reset;             /* redraw every tile */
+};
+
+/* Window state the compositor last applied for one content visual of a
+ * target, that is one overlay plane, see overlay.c. */
+struct composition_target_placement
+{
+    HWND swap_hwnd;
+    HWND parent;
+    int x;
+    int y;
+    int width;
+    int height;
+    LONG style;
+    HWND orig_parent;       /* restored when the plane is retired */
+    LONG orig_style;
+};
+
 struct composition_target
 {
     IDCompositionTarget IDCompositionTarget_iface;
@@ -44,29 +294,208 @@ struct composition_target
     IDCompositionVisual *root;
     BOOL topmost;
     HWND hwnd;
-    struct list entry;
+    struct wine_rb_entry tree_entry;
+    struct list active_entry;
+    struct list dirty_entry;
+    unsigned int frame_start; /* first entry in the frame being built, under device->cs */
+    BOOL active;
+    BOOL dirty;
+    /* Index of the visuals with content in this target's tree, in z-order,
+     * bottom-most first. Rebuilt by Commit when index_dirty is set. */
+    struct composition_visual **content_visuals;
+    SIZE_T content_visuals_size;
+    SIZE_T content_visual_count;
+    BOOL index_dirty;
+    /* Compiled by Commit from content_visuals, same length. */
+    struct draw_item *draw_list;
+    SIZE_T draw_list_size;
+    /* Overlay planes, indexed like content_visuals; compositor thread only. */
+    struct composition_target_placement *applied;
+    SIZE_T applied_size;
+    SIZE_T applied_count;
+    struct list overlay_entry; /* in device->overlay_targets, compositor thread only */
+    BOOL overlay_tracked;
+    UINT64 overlay_pass;    /* last pass that placed this target's planes */
+    /* Path selection, see overlay.c; compositor thread only. */
+    enum composition_path path;
+    unsigned int blend_count;   /* entries blended in this pass, from the bottom */
+    BOOL blend_reset;
+    UINT client_width, client_height;
+    BOOL direct_warned;     /* content that needed blending presented to the target itself */
+    BOOL readback_warned;   /* content that needed blending could not be read back */
+    /* Software composition state, see blend.c; current run only. */
+    UINT32 *blend_bits;
+    SIZE_T blend_bits_size;
+    UINT blend_width;
+    UINT blend_height;
+    UINT64 *tile_hashes;    /* signature of what each tile last showed */
+    SIZE_T tile_hashes_size;
+    unsigned int *dirty_tiles;
+    SIZE_T dirty_tiles_size;
+    struct blend_source *blend_sources;
+    SIZE_T blend_sources_size;
+    struct blend_window *blend_window; /* shows the result, set once by the compositor thread */
+    ID3D11Texture2D **blend_staging; /* readback copies, indexed like content_visuals */
+    SIZE_T blend_staging_size;
+    SIZE_T blend_staging_count;
+    /* Blending on the device's workers, one run at a time, under
+     * device->compose_lock. compose_next is the newest run queued while
+     * compose_run is in progress. */
+    struct worker_batch compose_batch;
+    struct target_run compose_run;
+    struct target_run compose_next;
+    UINT64 composed_seq;    /* frame of the last run finished */
+    BOOL composing;
+    LONG internal_ref;      /* one for the COM references, one per frame entry */
     LONG ref;
 };
 
+/* Visual fields are the staged state, read by Commit under device->cs.
+ * Structural calls (AddVisual, RemoveVisual, SetRoot) write them under
+ * device->cs; property setters queue a command instead, which Commit applies
+ * before reading. The compositor thread never touches visuals; it only sees
+ * the immutable frame that Commit builds from them. */
 struct composition_visual
 {
     IDCompositionVisual2 IDCompositionVisual2_iface;
+    struct composition_device *device;
     IUnknown *content;
-    struct list children;
-    struct list entry;
-    BOOL is_root;
-    float offset_x;
-    float offset_y;
+    struct list children;   /* child visuals in z-order, bottom-most first */
+    struct list entry;      /* in parent->children */
+    struct composition_visual *parent;
+    unsigned int content_count; /* visuals with content in this subtree, including itself */
+    struct composition_target *target; /* set while this visual is a target's root */
+    UINT32 slot;            /* index into device->props */
+    struct composition_transform *transform; /* transform object, referenced */
+    struct list transform_entry;    /* in transform->visuals */
+    struct list transform_pending_entry; /* in device->transform_visuals */
+    BOOL transform_pending;
+    SIZE_T content_index;   /* in target->content_visuals, if this visual has content */
+    /* Offset animations, x then y, referenced, with the QPC time each one
+     * starts at; the visual is in device->animated_visuals while it has any. */
+    struct animation_function *offset_animations[2];
+    LONGLONG animation_begin[2];
+    struct list animation_entry;
+    unsigned int animation_node; /* 1 + index while binding a frame's animations, otherwise 0 */
     int version;
     LONG ref;
 };
 
-struct visual_child
+enum transform_type
+{
+    TRANSFORM_TRANSLATE,
+    TRANSFORM_SCALE,
+    TRANSFORM_ROTATE,
+    TRANSFORM_SKEW,
+    TRANSFORM_MATRIX,       /* values are _11, _12, _21, _22, _31, _32 */
+    TRANSFORM_GROUP,
+};
+
+/* Indices into composition_transform.values, by type. */
+enum transform_value
+{
+    TRANSFORM_OFFSET_X = 0,
+    TRANSFORM_OFFSET_Y = 1,
+    TRANSFORM_SCALE_X = 0,
+    TRANSFORM_SCALE_Y = 1,
+    TRANSFORM_SCALE_CENTER_X = 2,
+    TRANSFORM_SCALE_CENTER_Y = 3,
+    TRANSFORM_ANGLE = 0,
+    TRANSFORM_ROTATE_CENTER_X = 1,
+    TRANSFORM_ROTATE_CENTER_Y = 2,
+    TRANSFORM_ANGLE_X = 0,
+    TRANSFORM_ANGLE_Y = 1,
+    TRANSFORM_SKEW_CENTER_X = 2,
+    TRANSFORM_SKEW_CENTER_Y = 3,
+    TRANSFORM_VALUE_COUNT = 6,
+};
+
+/* A group's reference to one of its transforms. */
+struct transform_link
+{
+    struct list entry;      /* in the child's groups */
+    struct composition_transform *group;
+};
+
+/* A 2D transform object, see transform.c. Parameters and links are staged
+ * state like visual fields: written under device->cs by Commit, which
+ * applies the queued changes, and by group creation. */
+struct composition_transform
+{
+    IDCompositionTransform IDCompositionTransform_iface;
+    struct composition_device *device;
+    enum transform_type type;
+    float values[TRANSFORM_VALUE_COUNT];
+    struct composition_transform **children; /* of a group, referenced, applied in order */
+    struct transform_link *links;   /* one per child, in its groups */
+    unsigned int child_count;
+    struct list groups;     /* links of the groups built on this transform */
+    struct list visuals;    /* visuals using it, by transform_entry */
+    D2D_MATRIX_3X2_F matrix; /* memoised, valid unless dirty */
+    BOOL dirty;
+    /* Parameter animations, referenced, with the QPC time each one starts
+     * at; the transform is in device->animated_transforms while it has any. */
+    struct animation_function *animations[TRANSFORM_VALUE_COUNT];
+    LONGLONG animation_begin[TRANSFORM_VALUE_COUNT];
+    unsigned int animation_count;
+    struct list animation_entry;
+    LONG ref;
+};
+
+enum animation_segment_type
+{
+    ANIMATION_SEGMENT_CUBIC,        /* coefficients are constant, linear, quadratic, cubic */
+    ANIMATION_SEGMENT_SINUSOIDAL,   /* coefficients are bias, amplitude, frequency, phase */
+    ANIMATION_SEGMENT_REPEAT,       /* repeats the span of duration before it */
+    ANIMATION_SEGMENT_END,          /* holds coefficients[0] */
+};
+
+struct animation_segment
+{
+    double begin;           /* in seconds from the start of the animation */
+    enum animation_segment_type type;
+    float coefficients[4];
+    double duration;
+};
+
+/* Immutable snapshot of an animation's segments, see animation.c. Shared by
+ * the properties it is set on and the frames using it. */
+struct animation_function
+{
+    LONG ref;
+    LONGLONG begin_time;    /* absolute QPC start time, 0 to start when applied by Commit */
+    unsigned int count;
+    struct animation_segment segments[];
+};
+
+struct composition_animation
+{
+    IDCompositionAnimation IDCompositionAnimation_iface;
+    SRWLOCK lock;           /* guards the fields below */
+    LONGLONG begin_time;
+    struct animation_segment *segments;
+    SIZE_T segments_size;
+    unsigned int segment_count;
+    BOOL ended;
+    struct animation_function *function; /* snapshot of the segments, if taken since the last change */
+    LONG ref;
+};
+
+/* Snapshot of a single content visual's compositing work. */
+struct composite_snapshot
 {
-    IDCompositionVisual2 *visual;
-    struct list entry;
+    struct composition_target *target; /* internal reference; released with the frame */
+    unsigned int index;     /* position in the target's draw list */
+    struct draw_item item;  /* item.content is AddRef'd and released with the frame */
 };
 
+/* Translated content keeps its pixels as they are, and can be an overlay plane. */
+static inline BOOL draw_item_is_translation(const struct draw_item *item)
+{
+    return item->transform._11 == 1.0f && item->transform._12 == 0.0f
+            && item->transform._21 == 0.0f && item->transform._22 == 1.0f;
+}
+
 static inline struct composition_device *impl_from_IDCompositionDevice(IDCompositionDevice *iface)
 {
     return CONTAINING_RECORD(iface, struct composition_device, IDCompositionDevice_iface);
@@ -93,7 +522,73 @@ static inline struct composition_visual *impl_from_IDCompositionVisual2(IDCompos
 }
 
 HRESULT create_target(struct composition_device *device, HWND hwnd, BOOL topmost, IDCompositionTarget **target);
-HRESULT create_visual(int version, REFIID iid, void **visual);
+int compare_target_hwnd(const void *key, const struct wine_rb_entry *entry);
+void target_mark_dirty(struct composition_target *target);
+void target_internal_addref(struct composition_target *target);
+void target_internal_release(struct composition_target *target);
+unsigned int select_composition_path(struct composition_device *device, const struct composite_snapshot *entries,
+        unsigned int count);
+unsigned int overlay_target(struct composition_device *device, const struct composite_snapshot *entries,
+        unsigned int count, unsigned int first, UINT64 pass);
+void overlay_retire_targets(struct composition_device *device, UINT64 pass);
+void overlay_cleanup(struct composition_device *device);
+void overlay_placement_lost(const struct window_placement *placement);
+BOOL blend_target(struct composition_device *device, const struct composite_snapshot *entries, unsigned int count,
+        UINT width, UINT height, BOOL reset);
+void blend_window_show(struct composition_device *device, struct composition_target *target, BOOL show);
+void blend_window_create(const struct window_placement *placement);
+void blend_window_placement_lost(const struct window_placement *placement);
+void blend_window_destroy(struct blend_window *window);
+void draw_item_bounds(const struct draw_item *item, UINT width, UINT height, RECT *rect);
+BOOL blend_content_readable(IUnknown *content);
+HRESULT create_visual(struct composition_device *device, int version, REFIID iid, void **visual);
+void apply_visual_commands(struct composition_device *device);
+HRESULT queue_transform_values(struct composition_transform *transform, unsigned int first, unsigned int count,
+        const float *values);
+HRESULT queue_transform_animation(struct composition_transform *transform, unsigned int index,
+        IDCompositionAnimation *animation);
+HRESULT create_transform(struct composition_device *device, enum transform_type type, void **transform);
+HRESULT create_transform_group(struct composition_device *device, IDCompositionTransform **transforms,
+        UINT count, IDCompositionTransform **group);
+struct composition_transform *unsafe_impl_from_IDCompositionTransform(IDCompositionTransform *iface);
+void transform_set_values(struct composition_transform *transform, unsigned int first, unsigned int count,
+        const float *values);
+void transform_set_animation(struct composition_transform *transform, unsigned int index,
+        struct animation_function *function);
+void transform_matrix(enum transform_type type, const float *values, D2D_MATRIX_3X2_F *matrix);
+const D2D_MATRIX_3X2_F *transform_evaluate(struct composition_transform *transform);
+void multiply_matrix(D2D_MATRIX_3X2_F *out, const D2D_MATRIX_3X2_F *a, const D2D_MATRIX_3X2_F *b);
+void free_visual_commands(struct composition_device *device);
+HRESULT create_animation(IDCompositionAnimation **animation);
+struct composition_animation *unsafe_impl_from_IDCompositionAnimation(IDCompositionAnimation *iface);
+struct animation_function *animation_snapshot(struct composition_animation *animation);
+void animation_function_addref(struct animation_function *function);
+void animation_function_release(struct animation_function *function);
+BOOL evaluate_animations(struct animation_batch *batch, const struct animation_binding *bindings,
+        SIZE_T count, LONGLONG time, LONGLONG frequency, BOOL *running);
+void animation_batch_cleanup(struct animation_batch *batch);
+BOOL visual_properties_add(struct visual_properties *props, struct composition_visual *visual);
+void visual_properties_remove(struct visual_properties *props, struct composition_visual *visual);
+void visual_properties_invalidate(struct visual_properties *props, UINT32 slot);
+BOOL visual_properties_set_transform(struct visual_properties *props, UINT32 slot, const D2D_MATRIX_3X2_F *matrix);
+void visual_properties_world_transform(const struct visual_properties *props, UINT32 slot,
+        D2D_MATRIX_3X2_F *matrix);
+void visual_properties_local_transform(const struct visual_properties *props, UINT32 slot,
+        D2D_MATRIX_3X2_F *matrix);
+void visual_properties_update(struct visual_properties *props);
+void visual_properties_cleanup(struct visual_properties *props);
+void object_pool_init(struct object_pool *pool, SIZE_T object_size, unsigned int objects_per_slab);
+void *object_pool_alloc(struct object_pool *pool);
+void object_pool_free(struct object_pool *pool, void *object);
+void object_pool_cleanup(struct object_pool *pool);
+BOOL dcomp_array_reserve(void **elements, SIZE_T *capacity, SIZE_T count, SIZE_T size);
+void worker_pool_init(struct worker_pool *pool);
+void worker_pool_cleanup(struct worker_pool *pool);
+void worker_pool_submit(struct worker_pool *pool, struct worker_batch *batch, worker_task_func func,
+        void *context, unsigned int count, void (*complete)(struct worker_batch *batch));
+void worker_pool_run(struct worker_pool *pool, worker_task_func func, void *context, unsigned int count);
+BOOL queue_window_placement(struct composition_device *device, const struct window_placement *placement);
+void flush_window_placements(struct composition_device *device);
 
 /* Store the HWND of the most recently created composition target for this thread.
  * Called from create_target(); read by __wine_dcomp_get_target_hwnd() in factory.c
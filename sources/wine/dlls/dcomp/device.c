@@ -18,6 +18,8 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
  */
 #include <stdarg.h>
+#include <float.h>
+#include <string.h>
 
 #include "initguid.h"
 
@@ -63,6 +65,32 @@ HWND CDECL __wine_dcomp_get_target_hwnd(void)
     return (HWND)TlsGetValue(idx);
 }
 
+BOOL dcomp_array_reserve(void **elements, SIZE_T *capacity, SIZE_T count, SIZE_T size)
+{
+    SIZE_T new_capacity, max_capacity;
+    void *new_elements;
+
+    if (count <= *capacity)
+        return TRUE;
+
+    max_capacity = ~(SIZE_T)0 / size;
+    if (count > max_capacity)
+        return FALSE;
+
+    new_capacity = max(4, *capacity);
+    while (new_capacity < count && new_capacity <= max_capacity / 2)
+        new_capacity *= 2;
+    if (new_capacity < count)
+        new_capacity = max_capacity;
+
+    if (!(new_elements = realloc(*elements, new_capacity * size)))
+        return FALSE;
+
+    *elements = new_elements;
+    *capacity = new_capacity;
+    return TRUE;
+}
+
 /*
  * IDCompositionDevice (v1) vtable implementation
  *
@@ -133,6 +161,8 @@ static ULONG STDMETHODCALLTYPE device1_AddRef(IDCompositionDevice *iface)
     return ref;
 }
 
+static void free_frame(struct composition_frame *frame);
+
 static ULONG STDMETHODCALLTYPE device1_Release(IDCompositionDevice *iface)
 {
     struct composition_device *device = impl_from_IDCompositionDevice(iface);
@@ -144,9 +174,27 @@ static ULONG STDMETHODCALLTYPE device1_Release(IDCompositionDevice *iface)
     {
         if (device->thread)
         {
+            device->thread_stop = TRUE;
+            SetEvent(device->commit_event);
             WaitForSingleObject(device->thread, INFINITE);
             CloseHandle(device->thread);
         }
+        /* Let the workers finish every run still in flight. */
+        worker_pool_cleanup(&device->workers);
+        overlay_cleanup(device);
+        if (device->commit_event)
+            CloseHandle(device->commit_event);
+        free_frame(device->pending_frame);
+        free_frame(device->animation_frame);
+        animation_batch_cleanup(&device->animation_batch);
+        free(device->animation_worlds);
+        free(device->placements);
+        free(device->visit_stack);
+        free(device->start_targets);
+        visual_properties_cleanup(&device->props);
+        free_visual_commands(device);
+        object_pool_cleanup(&device->visual_pool);
+        object_pool_cleanup(&device->target_pool);
         DeleteCriticalSection(&device->cs);
         free(device);
     }
@@ -154,190 +202,1058 @@ static ULONG STDMETHODCALLTYPE device1_Release(IDCompositionDevice *iface)
     return ref;
 }
 
-/* Find the first visual in a tree that has swap chain content (recursive DFS). */
-static struct composition_visual *find_content_visual(struct composition_visual *visual)
+static void init_frame_clock(struct composition_device *device)
 {
-    struct visual_child *child;
-    struct composition_visual *result;
+    DEVMODEW mode = {.dmSize = sizeof(mode)};
+    LARGE_INTEGER frequency, now;
+    DWORD refresh_rate = 60;
 
-    if (visual->content)
-        return visual;
+    if (EnumDisplaySettingsW(NULL, ENUM_CURRENT_SETTINGS, &mode) && mode.dmDisplayFrequency > 1)
+        refresh_rate = mode.dmDisplayFrequency;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    InitializeSRWLock(&device->clock_lock);
+    device->qpc_frequency = frequency.QuadPart;
+    device->frame_period = frequency.QuadPart / refresh_rate;
+    device->frame_epoch = now.QuadPart;
+    device->composition_rate.Numerator = refresh_rate;
+    device->composition_rate.Denominator = 1;
+
+    TRACE("composition rate %lu Hz, frame period %s ticks\n", refresh_rate,
+            wine_dbgstr_longlong(device->frame_period));
+}
+
+/* Return the start of the composition interval containing the given time. */
+static LONGLONG frame_clock_last_frame(struct composition_device *device, LONGLONG now)
+{
+    LONGLONG epoch;
+
+    AcquireSRWLockShared(&device->clock_lock);
+    epoch = device->frame_epoch;
+    ReleaseSRWLockShared(&device->clock_lock);
+
+    if (now <= epoch)
+        return epoch;
+    return epoch + (now - epoch) / device->frame_period * device->frame_period;
+}
+
+/* Realign the frame clock to a composition pass that just happened. */
+static void frame_clock_tick(struct composition_device *device)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    AcquireSRWLockExclusive(&device->clock_lock);
+    device->frame_epoch = now.QuadPart;
+    ReleaseSRWLockExclusive(&device->clock_lock);
+}
+
+/* Rebuild the target's index of content visuals in z-order: a visual's
+ * content is drawn below its children, and children bottom-most first.
+ * Subtrees without content are skipped. The walk uses an explicit stack, so
+ * deep trees cannot overflow the thread stack. Called with the device lock
+ * held. */
+static void update_content_index(struct composition_device *device, struct composition_target *target)
+{
+    struct composition_visual *visual, *child;
+    SIZE_T depth = 0;
 
-    LIST_FOR_EACH_ENTRY(child, &visual->children, struct visual_child, entry)
+    target->content_visual_count = 0;
+    target->index_dirty = FALSE;
+    if (!target->root)
+        return;
+
+    if (!dcomp_array_reserve((void **)&device->visit_stack, &device->visit_stack_size,
+            1, sizeof(*device->visit_stack)))
+        goto fail;
+    device->visit_stack[depth++] = impl_from_IDCompositionVisual(target->root);
+
+    while (depth)
     {
-        struct composition_visual *child_visual = impl_from_IDCompositionVisual2(child->visual);
-        result = find_content_visual(child_visual);
-        if (result)
-            return result;
+        visual = device->visit_stack[--depth];
+        if (!visual->content_count)
+            continue;
+
+        if (visual->content)
+        {
+            if (!dcomp_array_reserve((void **)&target->content_visuals, &target->content_visuals_size,
+                    target->content_visual_count + 1, sizeof(*target->content_visuals)))
+                goto fail;
+            visual->content_index = target->content_visual_count;
+            target->content_visuals[target->content_visual_count++] = visual;
+        }
+
+        /* Push in reverse so the bottom-most child is visited first. */
+        LIST_FOR_EACH_ENTRY_REV(child, &visual->children, struct composition_visual, entry)
+        {
+            if (!child->content_count)
+                continue;
+            if (!dcomp_array_reserve((void **)&device->visit_stack, &device->visit_stack_size,
+                    depth + 1, sizeof(*device->visit_stack)))
+                goto fail;
+            device->visit_stack[depth++] = child;
+        }
     }
 
-    return NULL;
+    TRACE("target %p has %Iu content visual(s)\n", target, target->content_visual_count);
+    return;
+
+fail:
+    ERR("Failed to index content visuals of target %p.\n", target);
+    target->content_visual_count = 0;
+    target->index_dirty = TRUE;
 }
 
-/* Maximum number of composition targets processed per Commit. */
-#define MAX_COMPOSITE_TARGETS 32
+/* Compile the target's draw list from its content index: one entry per
+ * content visual, in draw order, with the properties it inherits from its
+ * ancestors folded in, so the compositor never has to look at the tree.
+ * World properties must be up to date. Called with the device lock held. */
+static BOOL compile_draw_list(struct composition_device *device, struct composition_target *target)
+{
+    const struct visual_properties *props = &device->props;
+    static const D2D_RECT_F no_clip = {-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX};
+    struct composition_visual *visual;
+    struct draw_item *item;
+    SIZE_T i;
+
+    if (!dcomp_array_reserve((void **)&target->draw_list, &target->draw_list_size,
+            target->content_visual_count, sizeof(*target->draw_list)))
+    {
+        ERR("Failed to compile draw list of target %p.\n", target);
+        return FALSE;
+    }
 
-/* Snapshot of a single target's compositing work, collected under the device lock. */
-struct composite_snapshot
+    for (i = 0; i < target->content_visual_count; i++)
+    {
+        item = &target->draw_list[i];
+        visual = target->content_visuals[i];
+        item->content = visual->content;
+        visual_properties_world_transform(props, visual->slot, &item->transform);
+        item->offset_x = item->transform._31;
+        item->offset_y = item->transform._32;
+        item->clip = no_clip;
+        item->opacity = 1.0f;
+    }
+    return TRUE;
+}
+
+/* A visual of a frame whose offset or transform is animated, see
+ * bind_animations(). Bindings are indices into the frame's bindings, or -1
+ * for a value that does not change. */
+struct animation_node
 {
-    HWND target_hwnd;
-    IUnknown *content; /* AddRef'd; caller must Release after use */
-    float offset_x;
-    float offset_y;
+    int parent;             /* enclosing node, which comes first, or -1 */
+    D2D_MATRIX_3X2_F above; /* from the visual's parent to the enclosing node's visual, or to the target */
+    D2D_MATRIX_3X2_F transform; /* the visual's transform, unless it has leaves */
+    float offset[2];
+    int offset_bindings[2];
+    unsigned int first_leaf;
+    unsigned int leaf_count;
 };
 
-/* Reparent the swap chain's window into the target HWND so its Vulkan/Metal
- * surface becomes visible. Called WITHOUT the device lock held. */
-static void do_composite_work(const struct composite_snapshot *work)
+/* One of the transforms whose product, in order, is a node's transform. */
+struct animation_leaf
 {
-    IDXGISwapChain *swapchain = NULL;
-    DXGI_SWAP_CHAIN_DESC desc;
-    HWND swap_hwnd;
-    RECT rect;
-    HRESULT hr;
+    enum transform_type type;
+    float values[TRANSFORM_VALUE_COUNT];
+    int bindings[TRANSFORM_VALUE_COUNT];
+};
 
-    hr = IUnknown_QueryInterface(work->content, &IID_IDXGISwapChain, (void **)&swapchain);
-    if (FAILED(hr))
-    {
-        FIXME("Visual content %p is not an IDXGISwapChain, hr %#lx\n", work->content, hr);
+/* A frame entry inside an animated visual. */
+struct animated_entry
+{
+    unsigned int entry;
+    unsigned int node;      /* innermost node containing it */
+    D2D_MATRIX_3X2_F local; /* from the content to the node's visual */
+};
+
+/* Immutable snapshot of the committed state of every active target, built by
+ * Commit under the device lock and handed to the compositor thread, which
+ * reads it without taking any lock. Entries of one target are contiguous and
+ * in z-order, bottom-most first. When blending, the frame stays alive until
+ * every target in it has been composited.
+ *
+ * While a committed frame has running animations, the compositor keeps it
+ * and composes a copy of it at every composition interval, with the
+ * animated entries moved to where the animations are at that time. */
+struct composition_frame
+{
+    UINT64 commit;          /* sequence number of the Commit that built it */
+    UINT64 seq;             /* composition pass, assigned by the compositor */
+    struct list entry;      /* in device->inflight_frames while being blended */
+    /* Animations, of a committed frame only. */
+    struct animation_binding *bindings;
+    struct animation_node *nodes;
+    struct animation_leaf *leaves;
+    struct animated_entry *animated;
+    unsigned int binding_count;
+    unsigned int node_count;
+    unsigned int animated_count;
+    unsigned int count;
+    struct composite_snapshot entries[];
+};
+
+static void clear_frame_animations(struct composition_frame *frame)
+{
+    frame->bindings = NULL;
+    frame->nodes = NULL;
+    frame->leaves = NULL;
+    frame->animated = NULL;
+    frame->binding_count = 0;
+    frame->node_count = 0;
+    frame->animated_count = 0;
+}
+
+static void free_frame(struct composition_frame *frame)
+{
+    unsigned int i;
+
+    if (!frame)
         return;
+
+    for (i = 0; i < frame->binding_count; i++)
+        animation_function_release(frame->bindings[i].function);
+    free(frame->bindings);
+    free(frame->nodes);
+    free(frame->leaves);
+    free(frame->animated);
+    for (i = 0; i < frame->count; i++)
+    {
+        IUnknown_Release(frame->entries[i].item.content);
+        target_internal_release(frame->entries[i].target);
     }
+    free(frame);
+}
 
-    hr = IDXGISwapChain_GetDesc(swapchain, &desc);
-    IDXGISwapChain_Release(swapchain);
-    if (FAILED(hr))
+/* Copy a frame's entries, without its animations. */
+static struct composition_frame *clone_frame(const struct composition_frame *frame)
+{
+    struct composition_frame *clone;
+    unsigned int i;
+
+    if (!(clone = malloc(offsetof(struct composition_frame, entries[frame->count]))))
+        return NULL;
+
+    memcpy(clone, frame, offsetof(struct composition_frame, entries[frame->count]));
+    clear_frame_animations(clone);
+    for (i = 0; i < clone->count; i++)
     {
-        ERR("Failed to get swap chain desc, hr %#lx\n", hr);
-        return;
+        IUnknown_AddRef(clone->entries[i].item.content);
+        target_internal_addref(clone->entries[i].target);
     }
+    return clone;
+}
 
-    swap_hwnd = desc.OutputWindow;
-    TRACE("swap chain window %p, size %ux%u, target hwnd %p\n",
-            swap_hwnd, desc.BufferDesc.Width, desc.BufferDesc.Height, work->target_hwnd);
+/* The first visual in draw order with content in the visual's subtree. */
+static struct composition_visual *first_content_visual(struct composition_visual *visual)
+{
+    struct composition_visual *child;
 
-    if (!swap_hwnd || !IsWindow(swap_hwnd))
+    while (!visual->content)
     {
-        ERR("Swap chain has no valid output window %p\n", swap_hwnd);
-        return;
+        /* The subtree has content, so some child has. */
+        LIST_FOR_EACH_ENTRY(child, &visual->children, struct composition_visual, entry)
+        {
+            if (child->content_count)
+                break;
+        }
+        visual = child;
     }
+    return visual;
+}
+
+static struct composition_target *visual_get_target(struct composition_visual *visual)
+{
+    while (visual->parent)
+        visual = visual->parent;
+    return visual->target;
+}
+
+static void set_identity(D2D_MATRIX_3X2_F *matrix)
+{
+    matrix->_11 = matrix->_22 = 1.0f;
+    matrix->_12 = matrix->_21 = matrix->_31 = matrix->_32 = 0.0f;
+}
+
+/* A visual collected by bind_animations(). */
+struct animated_visual
+{
+    struct composition_visual *visual;
+    unsigned int depth;
+    unsigned int start;     /* its entries in the frame, once bound */
+    unsigned int count;
+};
+
+/* Scratch for bind_animations(). */
+struct animation_bind
+{
+    struct composition_frame *frame;
+    struct animated_visual *visuals;
+    SIZE_T visuals_size;
+    SIZE_T visual_count;
+    SIZE_T bindings_size;
+    SIZE_T leaves_size;
+    SIZE_T leaf_count;
+    SIZE_T animated_size;
+};
+
+/* Mark visuals collected with ~0u until they are numbered. */
+static BOOL collect_animated_visual(struct animation_bind *bind, struct composition_visual *visual)
+{
+    if (visual->animation_node)
+        return TRUE;
+    if (!dcomp_array_reserve((void **)&bind->visuals, &bind->visuals_size,
+            bind->visual_count + 1, sizeof(*bind->visuals)))
+        return FALSE;
+    bind->visuals[bind->visual_count++].visual = visual;
+    visual->animation_node = ~0u;
+    return TRUE;
+}
 
-    /* If the swap chain was created directly for the target window (via __wine_dcomp_get_target_hwnd),
-     * the Vulkan surface is already on the right NSView — no reparenting needed. */
-    if (swap_hwnd == work->target_hwnd)
+/* Collect the visuals using the transform, directly or through groups. */
+static BOOL collect_transform_visuals(struct animation_bind *bind, struct composition_transform *transform)
+{
+    struct composition_visual *visual;
+    struct transform_link *link;
+
+    LIST_FOR_EACH_ENTRY(visual, &transform->visuals, struct composition_visual, transform_entry)
     {
-        TRACE("swap chain window IS target hwnd %p, already rendering there\n", swap_hwnd);
-        return;
+        if (!collect_animated_visual(bind, visual))
+            return FALSE;
+    }
+    LIST_FOR_EACH_ENTRY(link, &transform->groups, struct transform_link, entry)
+    {
+        if (!collect_transform_visuals(bind, link->group))
+            return FALSE;
     }
+    return TRUE;
+}
+
+static int __cdecl compare_animated_visual_depth(const void *a, const void *b)
+{
+    const struct animated_visual *x = a, *y = b;
 
-    GetClientRect(work->target_hwnd, &rect);
-    TRACE("reparenting swap hwnd %p into target hwnd %p, client rect %ldx%ld\n",
-            swap_hwnd, work->target_hwnd, rect.right - rect.left, rect.bottom - rect.top);
-    SetParent(swap_hwnd, work->target_hwnd);
-    SetWindowLongW(swap_hwnd, GWL_STYLE,
-            (GetWindowLongW(swap_hwnd, GWL_STYLE) & ~WS_POPUP) | WS_CHILD | WS_VISIBLE);
-    SetWindowPos(swap_hwnd, HWND_TOP,
-            (int)work->offset_x, (int)work->offset_y,
-            rect.right - rect.left, rect.bottom - rect.top,
-            SWP_NOZORDER | SWP_FRAMECHANGED | SWP_SHOWWINDOW);
+    return x->depth < y->depth ? -1 : x->depth > y->depth;
 }
 
-static DWORD WINAPI composite_thread_proc(void *param)
+static BOOL transform_is_animated(const struct composition_transform *transform)
+{
+    unsigned int i;
+
+    if (transform->animation_count)
+        return TRUE;
+    for (i = 0; i < transform->child_count; i++)
+    {
+        if (transform_is_animated(transform->children[i]))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+static BOOL bind_value(struct animation_bind *bind, struct animation_function *function, LONGLONG begin,
+        float base, int *index)
+{
+    struct composition_frame *frame = bind->frame;
+    struct animation_binding *binding;
+
+    if (!dcomp_array_reserve((void **)&frame->bindings, &bind->bindings_size,
+            frame->binding_count + 1, sizeof(*frame->bindings)))
+        return FALSE;
+    binding = &frame->bindings[frame->binding_count];
+    binding->function = function;
+    animation_function_addref(function);
+    binding->begin = begin;
+    binding->base = base;
+    *index = frame->binding_count++;
+    return TRUE;
+}
+
+/* Append the transforms making up the transform, in the order they apply. */
+static BOOL bind_transform(struct animation_bind *bind, struct composition_transform *transform)
+{
+    struct animation_leaf *leaf;
+    unsigned int i;
+
+    for (i = 0; i < transform->child_count; i++)
+    {
+        if (!bind_transform(bind, transform->children[i]))
+            return FALSE;
+    }
+    if (transform->type == TRANSFORM_GROUP)
+        return TRUE;
+
+    if (!dcomp_array_reserve((void **)&bind->frame->leaves, &bind->leaves_size,
+            bind->leaf_count + 1, sizeof(*bind->frame->leaves)))
+        return FALSE;
+    leaf = &bind->frame->leaves[bind->leaf_count++];
+    leaf->type = transform->type;
+    memcpy(leaf->values, transform->values, sizeof(leaf->values));
+    for (i = 0; i < TRANSFORM_VALUE_COUNT; i++)
+    {
+        leaf->bindings[i] = -1;
+        if (transform->animations[i] && !bind_value(bind, transform->animations[i],
+                transform->animation_begin[i], transform->values[i], &leaf->bindings[i]))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Add a node for a visual shown in the frame. Visuals are bound outermost
+ * first, so the enclosing node, if any, is numbered already. */
+static BOOL bind_visual(struct composition_device *device, struct animation_bind *bind,
+        struct animated_visual *animated)
 {
-    struct composition_device *device = impl_from_IDCompositionDevice((IDCompositionDevice *)param);
-    struct composite_snapshot snapshots[MAX_COMPOSITE_TARGETS];
+    const struct visual_properties *props = &device->props;
+    struct composition_visual *visual = animated->visual, *ancestor;
+    struct composition_frame *frame = bind->frame;
     struct composition_target *target;
-    unsigned int n, i;
+    struct animation_node *node;
+    D2D_MATRIX_3X2_F local;
+    unsigned int axis;
+    SIZE_T start;
+
+    visual->animation_node = 0;
+    if (!visual->content_count || !(target = visual_get_target(visual)) || !target->active)
+        return TRUE;
+    start = first_content_visual(visual)->content_index;
+    if (start + visual->content_count > target->content_visual_count)
+        return TRUE;
+    animated->start = target->frame_start + start;
+    animated->count = visual->content_count;
+
+    node = &frame->nodes[frame->node_count];
+    node->parent = -1;
+    set_identity(&node->above);
+    for (ancestor = visual->parent; ancestor; ancestor = ancestor->parent)
+    {
+        if (ancestor->animation_node)
+        {
+            node->parent = ancestor->animation_node - 1;
+            break;
+        }
+        visual_properties_local_transform(props, ancestor->slot, &local);
+        multiply_matrix(&node->above, &node->above, &local);
+    }
 
-    TRACE("compositor thread started for device %p\n", device);
+    node->first_leaf = bind->leaf_count;
+    if (visual->transform && transform_is_animated(visual->transform))
+    {
+        if (!bind_transform(bind, visual->transform))
+            return FALSE;
+    }
+    else
+    {
+        visual_properties_local_transform(props, visual->slot, &node->transform);
+        node->transform._31 = props->transform_x[visual->slot];
+        node->transform._32 = props->transform_y[visual->slot];
+    }
+    node->leaf_count = bind->leaf_count - node->first_leaf;
 
-    /* Snapshot all targets that have content, under the device lock.
-     * We AddRef each content object so it stays alive after we drop the lock. */
-    n = 0;
-    EnterCriticalSection(&device->cs);
-    LIST_FOR_EACH_ENTRY(target, &device->targets, struct composition_target, entry)
+    for (axis = 0; axis < 2; axis++)
     {
-        struct composition_visual *root_visual, *content_visual;
+        node->offset[axis] = axis ? props->offset_y[visual->slot] : props->offset_x[visual->slot];
+        node->offset_bindings[axis] = -1;
+        if (visual->offset_animations[axis] && !bind_value(bind, visual->offset_animations[axis],
+                visual->animation_begin[axis], node->offset[axis], &node->offset_bindings[axis]))
+            return FALSE;
+    }
 
-        if (!target->root)
-            continue;
+    visual->animation_node = ++frame->node_count;
+    return TRUE;
+}
 
-        root_visual = impl_from_IDCompositionVisual(target->root);
-        content_visual = find_content_visual(root_visual);
-        if (!content_visual)
-            continue;
+/* Record each entry of an outermost animated visual relative to the
+ * innermost animated visual containing it. */
+static BOOL bind_entries(struct composition_device *device, struct animation_bind *bind,
+        const struct animated_visual *animated)
+{
+    struct composition_frame *frame = bind->frame;
+    const struct composite_snapshot *entry;
+    struct composition_visual *visual;
+    struct animated_entry *out;
+    D2D_MATRIX_3X2_F local;
+    unsigned int i;
+
+    if (!dcomp_array_reserve((void **)&frame->animated, &bind->animated_size,
+            frame->animated_count + animated->count, sizeof(*frame->animated)))
+        return FALSE;
 
-        if (n < MAX_COMPOSITE_TARGETS)
+    for (i = animated->start; i < animated->start + animated->count; i++)
+    {
+        entry = &frame->entries[i];
+        out = &frame->animated[frame->animated_count++];
+        out->entry = i;
+        set_identity(&out->local);
+        for (visual = entry->target->content_visuals[entry->index]; !visual->animation_node; visual = visual->parent)
         {
-            snapshots[n].target_hwnd = target->hwnd;
-            snapshots[n].content = content_visual->content;
-            IUnknown_AddRef(snapshots[n].content);
-            snapshots[n].offset_x = content_visual->offset_x;
-            snapshots[n].offset_y = content_visual->offset_y;
-            n++;
+            visual_properties_local_transform(&device->props, visual->slot, &local);
+            multiply_matrix(&out->local, &out->local, &local);
         }
+        out->node = visual->animation_node - 1;
     }
-    LeaveCriticalSection(&device->cs);
+    return TRUE;
+}
+
+/* Record the animations of the visuals shown in the frame. Each visual with
+ * an animated offset, or a transform with an animated parameter, becomes a
+ * node; the compositor evaluates the world transforms of the nodes,
+ * outermost first, and moves every entry inside one to its local transform
+ * times the world transform of the innermost node containing it. Everything
+ * else is as compiled, so nested animations compose as they would at a
+ * Commit. Called with the device lock held, once the frame's entries are
+ * filled in. */
+static BOOL bind_animations(struct composition_device *device, struct composition_frame *frame)
+{
+    struct animation_bind bind = {frame};
+    struct composition_transform *transform;
+    struct composition_visual *visual;
+    BOOL ret = FALSE;
+    SIZE_T i;
+
+    LIST_FOR_EACH_ENTRY(visual, &device->animated_visuals, struct composition_visual, animation_entry)
+    {
+        if (!collect_animated_visual(&bind, visual))
+            goto done;
+    }
+    LIST_FOR_EACH_ENTRY(transform, &device->animated_transforms, struct composition_transform, animation_entry)
+    {
+        if (!collect_transform_visuals(&bind, transform))
+            goto done;
+    }
+    if (!bind.visual_count)
+    {
+        ret = TRUE;
+        goto done;
+    }
+
+    for (i = 0; i < bind.visual_count; i++)
+    {
+        bind.visuals[i].depth = 0;
+        for (visual = bind.visuals[i].visual; visual->parent; visual = visual->parent)
+            bind.visuals[i].depth++;
+    }
+    qsort(bind.visuals, bind.visual_count, sizeof(*bind.visuals), compare_animated_visual_depth);
+
+    if (!(frame->nodes = malloc(bind.visual_count * sizeof(*frame->nodes))))
+        goto done;
+    for (i = 0; i < bind.visual_count; i++)
+    {
+        if (!bind_visual(device, &bind, &bind.visuals[i]))
+            goto done;
+    }
+    for (i = 0; i < bind.visual_count; i++)
+    {
+        if (bind.visuals[i].visual->animation_node
+                && frame->nodes[bind.visuals[i].visual->animation_node - 1].parent == -1
+                && !bind_entries(device, &bind, &bind.visuals[i]))
+            goto done;
+    }
+    ret = TRUE;
+
+done:
+    for (i = 0; i < bind.visual_count; i++)
+        bind.visuals[i].visual->animation_node = 0;
+    free(bind.visuals);
+    return ret;
+}
+
+/* Recompile the targets whose trees changed and move them in or out of the
+ * active set. Called with the device lock held. */
+static void update_active_targets(struct composition_device *device)
+{
+    struct composition_target *target, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE(target, next, &device->dirty_targets, struct composition_target, dirty_entry)
+    {
+        list_remove(&target->dirty_entry);
+        target->dirty = FALSE;
+
+        if (target->index_dirty)
+            update_content_index(device, target);
+        if (!compile_draw_list(device, target))
+            target->content_visual_count = 0;
+
+        if (target->content_visual_count && !target->active)
+        {
+            list_add_tail(&device->active_targets, &target->active_entry);
+            device->active_count++;
+            target->active = TRUE;
+        }
+        else if (!target->content_visual_count && target->active)
+        {
+            list_remove(&target->active_entry);
+            device->active_count--;
+            target->active = FALSE;
+        }
+    }
+}
+
+/* Build a frame by concatenating the draw lists of the active targets.
+ * Targets without content are never visited. Called with the device lock
+ * held. */
+static struct composition_frame *build_frame(struct composition_device *device)
+{
+    struct composition_target *target;
+    struct composition_frame *frame;
+    SIZE_T count = 0, i;
+
+    visual_properties_update(&device->props);
+    update_active_targets(device);
+
+    LIST_FOR_EACH_ENTRY(target, &device->active_targets, struct composition_target, active_entry)
+        count += target->content_visual_count;
+
+    if (!(frame = malloc(offsetof(struct composition_frame, entries[count]))))
+        return NULL;
+
+    clear_frame_animations(frame);
+    frame->count = 0;
+    LIST_FOR_EACH_ENTRY(target, &device->active_targets, struct composition_target, active_entry)
+    {
+        target->frame_start = frame->count;
+        for (i = 0; i < target->content_visual_count; i++)
+        {
+            struct composite_snapshot *entry = &frame->entries[frame->count++];
+
+            entry->target = target;
+            target_internal_addref(target);
+            entry->index = i;
+            entry->item = target->draw_list[i];
+            IUnknown_AddRef(entry->item.content);
+        }
+    }
+
+    if ((!list_empty(&device->animated_visuals) || !list_empty(&device->animated_transforms))
+            && !bind_animations(device, frame))
+    {
+        free_frame(frame);
+        return NULL;
+    }
+
+    return frame;
+}
 
-    /* Perform all window operations outside the lock to avoid deadlock.
-     * SetParent/SetWindowPos send messages to the target window's thread,
-     * which may be blocked in Commit() trying to acquire device->cs. */
-    for (i = 0; i < n; i++)
+/* Retire a commit and every earlier one it superseded. */
+static void retire_commit(struct composition_device *device, UINT64 seq)
+{
+    AcquireSRWLockExclusive(&device->fence_lock);
+    if (seq > device->retired_seq)
+        device->retired_seq = seq;
+    ReleaseSRWLockExclusive(&device->fence_lock);
+    WakeAllConditionVariable(&device->fence_cv);
+}
+
+/* A frame is done once each of its targets has finished a run of that frame
+ * or of a later one. Called with compose_lock held; moves the done frames,
+ * oldest first, to done. */
+static void collect_done_frames(struct composition_device *device, struct list *done)
+{
+    struct composition_frame *frame, *next;
+    unsigned int i;
+
+    LIST_FOR_EACH_ENTRY_SAFE(frame, next, &device->inflight_frames, struct composition_frame, entry)
     {
-        do_composite_work(&snapshots[i]);
-        IUnknown_Release(snapshots[i].content);
+        for (i = 0; i < frame->count; i++)
+        {
+            if (frame->entries[i].target->composed_seq < frame->seq)
+                return;
+        }
+        list_remove(&frame->entry);
+        list_add_tail(done, &frame->entry);
     }
+}
+
+static void retire_frames(struct composition_device *device, struct list *done)
+{
+    struct composition_frame *frame, *next;
 
-    if (!n)
-        TRACE("compositor thread: no content found\n");
+    LIST_FOR_EACH_ENTRY_SAFE(frame, next, done, struct composition_frame, entry)
+    {
+        retire_commit(device, frame->commit);
+        list_remove(&frame->entry);
+        free_frame(frame);
+    }
+}
+
+static void compose_target_task(void *context, unsigned int task)
+{
+    struct composition_target *target = context;
+    struct composition_device *device = impl_from_IDCompositionDevice(target->device);
+    const struct target_run *run = &target->compose_run;
+
+    blend_target(device, &run->frame->entries[run->start], run->count, run->width, run->height, run->reset);
+}
+
+/* Called on a worker once a target's run has finished. Starts the newest run
+ * queued for the target meanwhile, if any, and retires the frames that are
+ * now done. A queued run with nothing to blend is done at once. */
+static void compose_target_complete(struct worker_batch *batch)
+{
+    struct composition_target *target = CONTAINING_RECORD(batch, struct composition_target, compose_batch);
+    struct composition_device *device = impl_from_IDCompositionDevice(target->device);
+    struct list done = LIST_INIT(done);
+    UINT64 seq;
+    BOOL more;
+
+    /* Unless another run follows, the target may be freed as soon as the
+     * lock is released. */
+    AcquireSRWLockExclusive(&device->compose_lock);
+    seq = target->compose_run.frame->seq;
+    /* The target may have left blending, and caught up, meanwhile. */
+    target->composed_seq = max(target->composed_seq, seq);
+    if ((more = target->compose_next.frame && target->compose_next.count))
+    {
+        target->compose_run = target->compose_next;
+    }
     else
-        TRACE("compositor thread: composited %u target(s)\n", n);
+    {
+        if (target->compose_next.frame)
+            target->composed_seq = max(target->composed_seq, target->compose_next.frame->seq);
+        target->composing = FALSE;
+    }
+    target->compose_next.frame = NULL;
+    collect_done_frames(device, &done);
+    ReleaseSRWLockExclusive(&device->compose_lock);
 
-    EnterCriticalSection(&device->cs);
-    device->thread_exited = TRUE;
-    LeaveCriticalSection(&device->cs);
+    TRACE("target %p composed pass %s\n", target, wine_dbgstr_longlong(seq));
 
-    return 0;
+    if (more)
+        worker_pool_submit(&device->workers, &target->compose_batch, compose_target_task, target, 1,
+                compose_target_complete);
+    retire_frames(device, &done);
 }
 
-static HRESULT STDMETHODCALLTYPE device1_Commit(IDCompositionDevice *iface)
+/* Hand the blended entries of each target of a frame to the workers as a run
+ * of its own, so targets are blended concurrently and each one is presented
+ * as soon as it is done. A target still busy with an earlier frame picks up
+ * the newest one when it finishes; the runs queued for it in between are
+ * skipped. Targets with nothing to blend are done at once, unless an earlier
+ * run is still in flight, which may read any frame up to its own. The frame
+ * is retired once all its targets have caught up. */
+static unsigned int schedule_frame(struct composition_device *device, struct composition_frame *frame)
 {
-    struct composition_device *device = impl_from_IDCompositionDevice(iface);
+    struct list done = LIST_INIT(done);
+    struct composition_target *target;
+    unsigned int i, end, runs = 0;
+    struct target_run run;
 
-    TRACE("iface %p\n", iface);
+    /* Once the first run is submitted, the frame may be retired at any time;
+     * collect the targets to start beforehand. */
+    if (!dcomp_array_reserve((void **)&device->start_targets, &device->start_targets_size,
+            frame->count, sizeof(*device->start_targets)))
+    {
+        ERR("Failed to schedule commit %s.\n", wine_dbgstr_longlong(frame->commit));
+        retire_commit(device, frame->commit);
+        free_frame(frame);
+        return 0;
+    }
 
-    EnterCriticalSection(&device->cs);
+    run.frame = frame;
+    AcquireSRWLockExclusive(&device->compose_lock);
+    list_add_tail(&device->inflight_frames, &frame->entry);
+    for (i = 0; i < frame->count; i = end)
+    {
+        target = frame->entries[i].target;
+        for (end = i + 1; end < frame->count && frame->entries[end].target == target; end++)
+            ;
+        run.start = i;
+        run.count = target->blend_count;
+        run.width = target->client_width;
+        run.height = target->client_height;
+        run.reset = target->blend_reset;
+
+        if (!run.count && !target->composing)
+        {
+            target->composed_seq = frame->seq;
+            continue;
+        }
+        if (target->composing)
+        {
+            /* Tiles left stale by a skipped run still have to be redrawn. */
+            if (target->compose_next.frame)
+                run.reset |= target->compose_next.reset;
+            target->compose_next = run;
+            continue;
+        }
+        target->composing = TRUE;
+        target->compose_run = run;
+        device->start_targets[runs++] = target;
+    }
+    collect_done_frames(device, &done);
+    ReleaseSRWLockExclusive(&device->compose_lock);
 
-    if (!device->thread || device->thread_exited)
+    if (runs && !device->workers_started)
     {
-        if (device->thread)
+        worker_pool_init(&device->workers);
+        device->workers_started = TRUE;
+    }
+
+    /* Submit outside of the lock, as a run may complete right away. */
+    for (i = 0; i < runs; i++)
+        worker_pool_submit(&device->workers, &device->start_targets[i]->compose_batch, compose_target_task,
+                device->start_targets[i], 1, compose_target_complete);
+
+    retire_frames(device, &done);
+    return runs;
+}
+
+/* Move the entries of a frame to where the animations of the committed frame
+ * it was copied from are at the given time, see bind_animations(). Returns
+ * FALSE once none of them will move any more. Compositor thread only. */
+static BOOL animate_frame(struct composition_device *device, struct composition_frame *frame, LONGLONG time)
+{
+    const struct composition_frame *committed = device->animation_frame;
+    const float *values;
+    const struct animated_entry *animated;
+    const struct animation_node *node;
+    const struct animation_leaf *leaf;
+    D2D_MATRIX_3X2_F *world, matrix;
+    float leaf_values[TRANSFORM_VALUE_COUNT];
+    struct draw_item *item;
+    unsigned int i, j, k;
+    BOOL running;
+
+    if (!evaluate_animations(&device->animation_batch, committed->bindings, committed->binding_count,
+            time, device->qpc_frequency, &running)
+            || !dcomp_array_reserve((void **)&device->animation_worlds, &device->animation_worlds_size,
+            committed->node_count, sizeof(*device->animation_worlds)))
+    {
+        ERR("Failed to evaluate animations of commit %s.\n", wine_dbgstr_longlong(committed->commit));
+        return FALSE;
+    }
+    values = device->animation_batch.values;
+
+    for (i = 0; i < committed->node_count; i++)
+    {
+        node = &committed->nodes[i];
+        world = &device->animation_worlds[i];
+        if (!node->leaf_count)
+            *world = node->transform;
+        else
+            set_identity(world);
+        for (j = 0; j < node->leaf_count; j++)
         {
-            WaitForSingleObject(device->thread, INFINITE);
-            CloseHandle(device->thread);
+            leaf = &committed->leaves[node->first_leaf + j];
+            for (k = 0; k < TRANSFORM_VALUE_COUNT; k++)
+                leaf_values[k] = leaf->bindings[k] < 0 ? leaf->values[k] : values[leaf->bindings[k]];
+            transform_matrix(leaf->type, leaf_values, &matrix);
+            multiply_matrix(world, world, &matrix);
+        }
+        world->_31 += node->offset_bindings[0] < 0 ? node->offset[0] : values[node->offset_bindings[0]];
+        world->_32 += node->offset_bindings[1] < 0 ? node->offset[1] : values[node->offset_bindings[1]];
+        multiply_matrix(world, world, &node->above);
+        if (node->parent >= 0)
+            multiply_matrix(world, world, &device->animation_worlds[node->parent]);
+    }
+
+    for (i = 0; i < committed->animated_count; i++)
+    {
+        animated = &committed->animated[i];
+        item = &frame->entries[animated->entry].item;
+        multiply_matrix(&item->transform, &animated->local, &device->animation_worlds[animated->node]);
+        item->offset_x = item->transform._31;
+        item->offset_y = item->transform._32;
+    }
+    return running;
+}
+
+/* Take the frame for this pass: the most recently committed one, or, while
+ * animations run, a copy of the last one that had any. Its animations are
+ * evaluated at the time of the pass. Compositor thread only. */
+static struct composition_frame *take_frame(struct composition_device *device, BOOL *committed)
+{
+    struct composition_frame *frame, *copy;
+    LARGE_INTEGER now;
+    UINT64 merged;
+
+    if ((*committed = !!(frame = InterlockedExchangePointer((void **)&device->pending_frame, NULL))))
+    {
+        /* Sequence numbers are consecutive, so any gap since the last frame
+         * taken is the number of commits this pass absorbed. */
+        merged = frame->commit - device->taken_seq - 1;
+        device->taken_seq = frame->commit;
+        if (merged)
+        {
+            AcquireSRWLockExclusive(&device->fence_lock);
+            device->coalesced_commits += merged;
+            ReleaseSRWLockExclusive(&device->fence_lock);
         }
-        device->thread_exited = FALSE;
-        device->thread = CreateThread(NULL, 0, composite_thread_proc, iface, 0, NULL);
+
+        /* A commit replaces the animations of the one before. */
+        free_frame(device->animation_frame);
+        device->animation_frame = NULL;
+        if (frame->binding_count)
+        {
+            if ((copy = clone_frame(frame)))
+            {
+                device->animation_frame = frame;
+                frame = copy;
+            }
+            else
+            {
+                ERR("Failed to animate commit %s.\n", wine_dbgstr_longlong(frame->commit));
+            }
+        }
+    }
+    else if (!device->animation_frame || !(frame = clone_frame(device->animation_frame)))
+    {
+        return NULL;
+    }
+
+    frame->seq = ++device->pass_seq;
+    QueryPerformanceCounter(&now);
+    if (device->animation_frame && !animate_frame(device, frame, now.QuadPart))
+    {
+        TRACE("animations of commit %s settled\n", wine_dbgstr_longlong(device->animation_frame->commit));
+        free_frame(device->animation_frame);
+        device->animation_frame = NULL;
+    }
+    return frame;
+}
+
+/* Apply the most recently committed frame, or advance the running
+ * animations. Runs on the compositor thread and never takes the device lock,
+ * and never waits on another thread: window operations are posted to the
+ * threads owning the windows, see window.c, and blending is left to the
+ * workers. Each target picks its own path. */
+static void composite_targets(struct composition_device *device)
+{
+    unsigned int i, end, blend_count, runs, n = 0;
+    struct composition_frame *frame;
+    BOOL committed;
+    UINT64 commit, seq;
+
+    if (!(frame = take_frame(device, &committed)))
+        return;
+    commit = frame->commit;
+    seq = frame->seq;
+
+    for (i = 0; i < frame->count; i = end)
+    {
+        for (end = i + 1; end < frame->count && frame->entries[end].target == frame->entries[i].target; end++)
+            ;
+        blend_count = select_composition_path(device, &frame->entries[i], end - i);
+        n += overlay_target(device, &frame->entries[i], end - i, blend_count, seq);
     }
+    overlay_retire_targets(device, seq);
+    flush_window_placements(device);
+
+    runs = schedule_frame(device, frame);
+    frame_clock_tick(device);
+
+    TRACE("%s commit %s (%s merged in total), updated %u plane(s), blending %u target(s)\n",
+            committed ? "applied" : "animated", wine_dbgstr_longlong(commit),
+            wine_dbgstr_longlong(device->coalesced_commits), n, runs);
+}
+
+/* If a pass already ran in the current composition interval, hold off until
+ * the next frame boundary so every commit landing in between is merged into
+ * a single pass. Returns FALSE if the device is shutting down. */
+static BOOL wait_for_next_frame(struct composition_device *device)
+{
+    LONGLONG deadline = device->frame_epoch + device->frame_period;
+    LARGE_INTEGER now;
 
+    for (;;)
+    {
+        QueryPerformanceCounter(&now);
+        if (now.QuadPart >= deadline)
+            return TRUE;
+
+        /* Further commits may wake us early; they just replace the pending frame. */
+        WaitForSingleObject(device->commit_event,
+                (deadline - now.QuadPart) * 1000 / device->qpc_frequency + 1);
+        if (device->thread_stop)
+            return FALSE;
+    }
+}
+
+/* One compositor thread lives for the whole lifetime of the device. It sleeps
+ * on commit_event, unless animations are running, and runs at most one
+ * composition pass per composition interval, however many times Commit
+ * signals it. */
+static DWORD WINAPI composite_thread_proc(void *param)
+{
+    struct composition_device *device = param;
+
+    SetThreadDescription(GetCurrentThread(), L"wine_dcomp_compositor");
+    TRACE("compositor thread started for device %p\n", device);
+
+    for (;;)
+    {
+        WaitForSingleObject(device->commit_event, device->animation_frame ? 0 : INFINITE);
+        if (device->thread_stop || !wait_for_next_frame(device))
+            break;
+        composite_targets(device);
+    }
+
+    TRACE("compositor thread exiting for device %p\n", device);
+    return 0;
+}
+
+static HRESULT STDMETHODCALLTYPE device1_Commit(IDCompositionDevice *iface)
+{
+    struct composition_device *device = impl_from_IDCompositionDevice(iface);
+    struct composition_frame *frame;
+
+    TRACE("iface %p\n", iface);
+
+    EnterCriticalSection(&device->cs);
+    apply_visual_commands(device);
+    if ((frame = build_frame(device)))
+        frame->commit = ++device->commit_seq;
     LeaveCriticalSection(&device->cs);
+    if (!frame)
+        return E_OUTOFMEMORY;
 
+    /* A frame the compositor has not picked up yet is superseded by this one. */
+    free_frame(InterlockedExchangePointer((void **)&device->pending_frame, frame));
+    SetEvent(device->commit_event);
     return S_OK;
 }
 
+/* Block until the compositor has applied the last commit issued on this device. */
 static HRESULT STDMETHODCALLTYPE device1_WaitForCommitCompletion(IDCompositionDevice *iface)
 {
+    struct composition_device *device = impl_from_IDCompositionDevice(iface);
+    UINT64 seq;
+
     TRACE("iface %p\n", iface);
+
+    EnterCriticalSection(&device->cs);
+    seq = device->commit_seq;
+    LeaveCriticalSection(&device->cs);
+
+    AcquireSRWLockExclusive(&device->fence_lock);
+    while (device->retired_seq < seq)
+        SleepConditionVariableSRW(&device->fence_cv, &device->fence_lock, INFINITE, 0);
+    ReleaseSRWLockExclusive(&device->fence_lock);
+
+    TRACE("commit %s retired\n", wine_dbgstr_longlong(seq));
     return S_OK;
 }
 
 static HRESULT STDMETHODCALLTYPE device1_GetFrameStatistics(IDCompositionDevice *iface,
         DCOMPOSITION_FRAME_STATISTICS *statistics)
 {
+    struct composition_device *device = impl_from_IDCompositionDevice(iface);
+    LARGE_INTEGER now;
+    LONGLONG last;
+
     TRACE("iface %p, statistics %p\n", iface, statistics);
 
     if (!statistics)
         return E_INVALIDARG;
 
-    memset(statistics, 0, sizeof(*statistics));
+    QueryPerformanceCounter(&now);
+    last = frame_clock_last_frame(device, now.QuadPart);
+
+    statistics->lastFrameTime.QuadPart = last;
+    statistics->currentCompositionRate = device->composition_rate;
+    statistics->currentTime = now;
+    statistics->timeFrequency.QuadPart = device->qpc_frequency;
+    statistics->nextEstimatedFrameTime.QuadPart = last + device->frame_period;
     return S_OK;
 }
 
@@ -353,8 +1269,10 @@ static HRESULT STDMETHODCALLTYPE device1_CreateTargetForHwnd(IDCompositionDevice
 static HRESULT STDMETHODCALLTYPE device1_CreateVisual(IDCompositionDevice *iface,
         IDCompositionVisual **visual)
 {
+    struct composition_device *device = impl_from_IDCompositionDevice(iface);
+
     TRACE("iface %p, visual %p\n", iface, visual);
-    return create_visual(1, &IID_IDCompositionVisual, (void **)visual);
+    return create_visual(device, 1, &IID_IDCompositionVisual, (void **)visual);
 }
 
 static HRESULT STDMETHODCALLTYPE device1_CreateSurface(IDCompositionDevice *iface,
@@ -392,45 +1310,51 @@ static HRESULT STDMETHODCALLTYPE device1_CreateSurfaceFromHwnd(IDCompositionDevi
 static HRESULT STDMETHODCALLTYPE device1_CreateTranslateTransform(IDCompositionDevice *iface,
         IDCompositionTranslateTransform **transform)
 {
-    FIXME("iface %p, transform %p: stub\n", iface, transform);
-    return E_NOTIMPL;
+    TRACE("iface %p, transform %p\n", iface, transform);
+
+    return create_transform(impl_from_IDCompositionDevice(iface), TRANSFORM_TRANSLATE, (void **)transform);
 }
 
 static HRESULT STDMETHODCALLTYPE device1_CreateScaleTransform(IDCompositionDevice *iface,
         IDCompositionScaleTransform **transform)
 {
-    FIXME("iface %p, transform %p: stub\n", iface, transform);
-    return E_NOTIMPL;
+    TRACE("iface %p, transform %p\n", iface, transform);
+
+    return create_transform(impl_from_IDCompositionDevice(iface), TRANSFORM_SCALE, (void **)transform);
 }
 
 static HRESULT STDMETHODCALLTYPE device1_CreateRotateTransform(IDCompositionDevice *iface,
         IDCompositionRotateTransform **transform)
 {
-    FIXME("iface %p, transform %p: stub\n", iface, transform);
-    return E_NOTIMPL;
+    TRACE("iface %p, transform %p\n", iface, transform);
+
+    return create_transform(impl_from_IDCompositionDevice(iface), TRANSFORM_ROTATE, (void **)transform);
 }
 
 static HRESULT STDMETHODCALLTYPE device1_CreateSkewTransform(IDCompositionDevice *iface,
         IDCompositionSkewTransform **transform)
 {
-    FIXME("iface %p, transform %p: stub\n", iface, transform);
-    return E_NOTIMPL;
+    TRACE("iface %p, transform %p\n", iface, transform);
+
+    return create_transform(impl_from_IDCompositionDevice(iface), TRANSFORM_SKEW, (void **)transform);
 }
 
 static HRESULT STDMETHODCALLTYPE device1_CreateMatrixTransform(IDCompositionDevice *iface,
         IDCompositionMatrixTransform **transform)
 {
-    FIXME("iface %p, transform %p: stub\n", iface, transform);
-    return E_NOTIMPL;
+    TRACE("iface %p, transform %p\n", iface, transform);
+
+    return create_transform(impl_from_IDCompositionDevice(iface), TRANSFORM_MATRIX, (void **)transform);
 }
 
 static HRESULT STDMETHODCALLTYPE device1_CreateTransformGroup(IDCompositionDevice *iface,
         IDCompositionTransform **transforms, UINT elements,
         IDCompositionTransform **transform_group)
 {
-    FIXME("iface %p, transforms %p, elements %u, transform_group %p: stub\n", iface,
+    TRACE("iface %p, transforms %p, elements %u, transform_group %p\n", iface,
             transforms, elements, transform_group);
-    return E_NOTIMPL;
+
+    return create_transform_group(impl_from_IDCompositionDevice(iface), transforms, elements, transform_group);
 }
 
 static HRESULT STDMETHODCALLTYPE device1_CreateTranslateTransform3D(IDCompositionDevice *iface,
@@ -487,8 +1411,9 @@ static HRESULT STDMETHODCALLTYPE device1_CreateRectangleClip(IDCompositionDevice
 static HRESULT STDMETHODCALLTYPE device1_CreateAnimation(IDCompositionDevice *iface,
         IDCompositionAnimation **animation)
 {
-    FIXME("iface %p, animation %p: stub\n", iface, animation);
-    return E_NOTIMPL;
+    TRACE("iface %p, animation %p\n", iface, animation);
+
+    return create_animation(animation);
 }
 
 static HRESULT STDMETHODCALLTYPE device1_CheckDeviceState(IDCompositionDevice *iface,
@@ -588,27 +1513,26 @@ static HRESULT STDMETHODCALLTYPE desktop_device_Commit(IDCompositionDesktopDevic
 static HRESULT STDMETHODCALLTYPE desktop_device_WaitForCommitCompletion(
         IDCompositionDesktopDevice *iface)
 {
-    TRACE("iface %p\n", iface);
-    return S_OK;
+    struct composition_device *device = impl_from_IDCompositionDesktopDevice(iface);
+
+    return device1_WaitForCommitCompletion(&device->IDCompositionDevice_iface);
 }
 
 static HRESULT STDMETHODCALLTYPE desktop_device_GetFrameStatistics(
         IDCompositionDesktopDevice *iface, DCOMPOSITION_FRAME_STATISTICS *statistics)
 {
-    TRACE("iface %p, statistics %p\n", iface, statistics);
-
-    if (!statistics)
-        return E_INVALIDARG;
+    struct composition_device *device = impl_from_IDCompositionDesktopDevice(iface);
 
-    memset(statistics, 0, sizeof(*statistics));
-    return S_OK;
+    return device1_GetFrameStatistics(&device->IDCompositionDevice_iface, statistics);
 }
 
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateVisual(IDCompositionDesktopDevice *iface,
         IDCompositionVisual2 **visual)
 {
+    struct composition_device *device = impl_from_IDCompositionDesktopDevice(iface);
+
     TRACE("iface %p, visual %p\n", iface, visual);
-    return create_visual(2, &IID_IDCompositionVisual2, (void **)visual);
+    return create_visual(device, 2, &IID_IDCompositionVisual2, (void **)visual);
 }
 
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateSurfaceFactory(
@@ -641,45 +1565,51 @@ static HRESULT STDMETHODCALLTYPE desktop_device_CreateVirtualSurface(
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateTranslateTransform(
         IDCompositionDesktopDevice *iface, IDCompositionTranslateTransform **transform)
 {
-    FIXME("iface %p, transform %p: stub\n", iface, transform);
-    return E_NOTIMPL;
+    TRACE("iface %p, transform %p\n", iface, transform);
+
+    return create_transform(impl_from_IDCompositionDesktopDevice(iface), TRANSFORM_TRANSLATE, (void **)transform);
 }
 
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateScaleTransform(
         IDCompositionDesktopDevice *iface, IDCompositionScaleTransform **transform)
 {
-    FIXME("iface %p, transform %p: stub\n", iface, transform);
-    return E_NOTIMPL;
+    TRACE("iface %p, transform %p\n", iface, transform);
+
+    return create_transform(impl_from_IDCompositionDesktopDevice(iface), TRANSFORM_SCALE, (void **)transform);
 }
 
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateRotateTransform(
         IDCompositionDesktopDevice *iface, IDCompositionRotateTransform **transform)
 {
-    FIXME("iface %p, transform %p: stub\n", iface, transform);
-    return E_NOTIMPL;
+    TRACE("iface %p, transform %p\n", iface, transform);
+
+    return create_transform(impl_from_IDCompositionDesktopDevice(iface), TRANSFORM_ROTATE, (void **)transform);
 }
 
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateSkewTransform(
         IDCompositionDesktopDevice *iface, IDCompositionSkewTransform **transform)
 {
-    FIXME("iface %p, transform %p: stub\n", iface, transform);
-    return E_NOTIMPL;
+    TRACE("iface %p, transform %p\n", iface, transform);
+
+    return create_transform(impl_from_IDCompositionDesktopDevice(iface), TRANSFORM_SKEW, (void **)transform);
 }
 
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateMatrixTransform(
         IDCompositionDesktopDevice *iface, IDCompositionMatrixTransform **transform)
 {
-    FIXME("iface %p, transform %p: stub\n", iface, transform);
-    return E_NOTIMPL;
+    TRACE("iface %p, transform %p\n", iface, transform);
+
+    return create_transform(impl_from_IDCompositionDesktopDevice(iface), TRANSFORM_MATRIX, (void **)transform);
 }
 
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateTransformGroup(
         IDCompositionDesktopDevice *iface, IDCompositionTransform **transforms, UINT elements,
         IDCompositionTransform **transform_group)
 {
-    FIXME("iface %p, transforms %p, elements %u, transform_group %p: stub\n", iface,
+    TRACE("iface %p, transforms %p, elements %u, transform_group %p\n", iface,
             transforms, elements, transform_group);
-    return E_NOTIMPL;
+
+    return create_transform_group(impl_from_IDCompositionDesktopDevice(iface), transforms, elements, transform_group);
 }
 
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateTranslateTransform3D(
@@ -736,8 +1666,9 @@ static HRESULT STDMETHODCALLTYPE desktop_device_CreateRectangleClip(
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateAnimation(
         IDCompositionDesktopDevice *iface, IDCompositionAnimation **animation)
 {
-    FIXME("iface %p, animation %p: stub\n", iface, animation);
-    return E_NOTIMPL;
+    TRACE("iface %p, animation %p\n", iface, animation);
+
+    return create_animation(animation);
 }
 
 static HRESULT STDMETHODCALLTYPE desktop_device_CreateTargetForHwnd(
@@ -802,6 +1733,21 @@ static const struct IDCompositionDesktopDeviceVtbl desktop_device_vtbl =
  * Device factory function and exported DCompositionCreateDevice* APIs
  */
 
+/* By default every target picks overlays or blending per frame. Setting
+ * WINE_DCOMP_COMPOSITOR to overlay or blend forces one path. */
+static enum composition_mode get_composition_mode(void)
+{
+    WCHAR value[16];
+
+    if (!GetEnvironmentVariableW(L"WINE_DCOMP_COMPOSITOR", value, ARRAY_SIZE(value)))
+        return COMPOSITION_MODE_ADAPTIVE;
+    if (!lstrcmpiW(value, L"overlay"))
+        return COMPOSITION_MODE_OVERLAY;
+    if (!lstrcmpiW(value, L"blend"))
+        return COMPOSITION_MODE_BLEND;
+    return COMPOSITION_MODE_ADAPTIVE;
+}
+
 static HRESULT create_device(int version, REFIID iid, void **device)
 {
     struct composition_device *object;
@@ -822,8 +1768,33 @@ static HRESULT create_device(int version, REFIID iid, void **device)
     object->IDCompositionDesktopDevice_iface.lpVtbl = &desktop_device_vtbl;
     object->version = version;
     object->ref = 1;
+    object->mode = get_composition_mode();
+    object_pool_init(&object->visual_pool, sizeof(struct composition_visual), 64);
+    object_pool_init(&object->target_pool, sizeof(struct composition_target), 16);
     InitializeCriticalSection(&object->cs);
-    list_init(&object->targets);
+    InitializeSRWLock(&object->compose_lock);
+    list_init(&object->inflight_frames);
+    list_init(&object->overlay_targets);
+    InitializeSRWLock(&object->fence_lock);
+    InitializeConditionVariable(&object->fence_cv);
+    init_frame_clock(object);
+    wine_rb_init(&object->target_tree, compare_target_hwnd);
+    list_init(&object->active_targets);
+    list_init(&object->dirty_targets);
+    list_init(&object->transform_visuals);
+    list_init(&object->animated_visuals);
+    list_init(&object->animated_transforms);
+    InitializeSListHead(&object->commands);
+    InitializeSListHead(&object->free_commands);
+
+    if (!(object->commit_event = CreateEventW(NULL, FALSE, FALSE, NULL))
+            || !(object->thread = CreateThread(NULL, 0, composite_thread_proc, object, 0, NULL)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        ERR("Failed to start compositor thread, hr %#lx.\n", hr);
+        IDCompositionDevice_Release(&object->IDCompositionDevice_iface);
+        return hr;
+    }
 
     hr = IDCompositionDevice_QueryInterface(&object->IDCompositionDevice_iface, iid, device);
     IDCompositionDevice_Release(&object->IDCompositionDevice_iface);
@@ -847,3 +1818,30 @@ HRESULT WINAPI DCompositionCreateDevice3(IUnknown *rendering_device, REFIID iid,
     TRACE("%p, %s, %p\n", rendering_device, debugstr_guid(iid), device);
     return create_device(3, iid, device);
 }
+
+/* Return the number of commits the compositor merged into a later pass
+ * instead of applying them in a pass of their own. dcomp has no way to
+ * report this, so it is exported for the tests. */
+HRESULT CDECL __wine_dcomp_get_coalesced_commits(IUnknown *iface, UINT64 *count)
+{
+    struct composition_device *device;
+    IDCompositionDevice *device1;
+
+    if (!iface || !count)
+        return E_INVALIDARG;
+    if (FAILED(IUnknown_QueryInterface(iface, &IID_IDCompositionDevice, (void **)&device1)))
+        return E_INVALIDARG;
+    if (device1->lpVtbl != &device1_vtbl)
+    {
+        IDCompositionDevice_Release(device1);
+        return E_INVALIDARG;
+    }
+    device = impl_from_IDCompositionDevice(device1);
+
+    AcquireSRWLockShared(&device->fence_lock);
+    *count = device->coalesced_commits;
+    ReleaseSRWLockShared(&device->fence_lock);
+
+    IDCompositionDevice_Release(device1);
+    return S_OK;
+}
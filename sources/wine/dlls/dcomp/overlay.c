@@ -0,0 +1,533 @@
+/*
+ * Copyright 2026 Porthole contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#include <stdarg.h>
+#include <float.h>
+#include <string.h>
+
+#define COBJMACROS
+#include "windef.h"
+#include "winbase.h"
+#include "wingdi.h"
+#include "winuser.h"
+#include "dxgi1_2.h"
+#include "dcomp_private.h"
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(dcomp);
+
+/* Overlay composition. Every content visual is shown as a plane: the output
+ * window of its swap chain, made a child of the target window and placed,
+ * sized and stacked to match the target's draw list. The Vulkan/Metal
+ * surface behind each plane presents directly, so nothing is copied.
+ *
+ * A target's planes are indexed like its draw list, in target->applied.
+ * Windows are adopted when their visual first appears in the target, moved
+ * and restacked as the draw list changes, and retired, that is hidden and
+ * handed back to their original parent, once no visual of the target shows
+ * them any more. Targets with planes are kept on device->overlay_targets so
+ * that their planes are retired when they leave the frame.
+ *
+ * Everything here runs on the compositor thread, without any lock; window
+ * operations are queued for flush_window_placements(). */
+
+/* The plane last queued for a target's index-th content visual. */
+static struct composition_target_placement *target_applied(struct composition_target *target, unsigned int index)
+{
+    if (index >= target->applied_count)
+    {
+        if (!dcomp_array_reserve((void **)&target->applied, &target->applied_size,
+                index + 1, sizeof(*target->applied)))
+            return NULL;
+        memset(&target->applied[target->applied_count], 0,
+                (index + 1 - target->applied_count) * sizeof(*target->applied));
+        target->applied_count = index + 1;
+    }
+    return &target->applied[index];
+}
+
+static const struct composition_target_placement *find_plane(const struct composition_target_placement *planes,
+        SIZE_T count, HWND hwnd)
+{
+    SIZE_T i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (planes[i].swap_hwnd == hwnd)
+            return &planes[i];
+    }
+    return NULL;
+}
+
+static void retire_plane(struct composition_device *device, const struct composition_target_placement *plane)
+{
+    struct window_placement placement = {0};
+
+    if (!IsWindow(plane->swap_hwnd))
+        return;
+
+    TRACE("retiring swap hwnd %p from parent %p\n", plane->swap_hwnd, plane->parent);
+    placement.hwnd = plane->swap_hwnd;
+    placement.parent = plane->orig_parent;
+    placement.retire = TRUE;
+    placement.reparent = TRUE;
+    placement.style = plane->orig_style & ~WS_VISIBLE;
+    queue_window_placement(device, &placement);
+}
+
+/* Work out how the swap chain's window must be placed as the index-th plane
+ * of the target, and queue the window operations. old holds the target's
+ * planes before this pass, so that a window moving within the z-order keeps
+ * its adoption state.
+ *
+ * Only the fields that differ from what was last queued produce an
+ * operation, so a steady-state frame queues nothing. Once a different window
+ * shows up at some position of the target's z-order, *restack is set and
+ * that window and every one above it are restacked, bottom-most first.
+ * Returns TRUE if any window state is to be changed. */
+static BOOL place_plane(struct composition_device *device, const struct composite_snapshot *work,
+        const struct composition_target_placement *old, SIZE_T old_count, BOOL *restack)
+{
+    const struct composition_target_placement *previous;
+    struct composition_target_placement *applied;
+    struct window_placement placement = {0};
+    HWND target_hwnd = work->target->hwnd;
+    IDXGISwapChain *swapchain = NULL;
+    DXGI_SWAP_CHAIN_DESC desc;
+    HWND swap_hwnd;
+    RECT rect;
+    HRESULT hr;
+
+    if (!(applied = target_applied(work->target, work->index)))
+    {
+        ERR("Failed to track plane %u of target %p.\n", work->index, work->target);
+        return FALSE;
+    }
+
+    hr = IUnknown_QueryInterface(work->item.content, &IID_IDXGISwapChain, (void **)&swapchain);
+    if (FAILED(hr))
+    {
+        FIXME("Visual content %p is not an IDXGISwapChain, hr %#lx\n", work->item.content, hr);
+        memset(applied, 0, sizeof(*applied));
+        return FALSE;
+    }
+
+    hr = IDXGISwapChain_GetDesc(swapchain, &desc);
+    IDXGISwapChain_Release(swapchain);
+    if (FAILED(hr))
+    {
+        ERR("Failed to get swap chain desc, hr %#lx\n", hr);
+        memset(applied, 0, sizeof(*applied));
+        return FALSE;
+    }
+
+    swap_hwnd = desc.OutputWindow;
+
+    /* If the swap chain was created directly for the target window (via __wine_dcomp_get_target_hwnd),
+     * the Vulkan surface is already on the right NSView — it is the base plane and needs no window. */
+    if (swap_hwnd == target_hwnd || !swap_hwnd || !IsWindow(swap_hwnd))
+    {
+        if (swap_hwnd != target_hwnd)
+            ERR("Swap chain has no valid output window %p\n", swap_hwnd);
+        memset(applied, 0, sizeof(*applied));
+        return FALSE;
+    }
+
+    if (applied->swap_hwnd != swap_hwnd)
+    {
+        /* The window may have been a plane at another position. */
+        if ((previous = find_plane(old, old_count, swap_hwnd)))
+            *applied = *previous;
+        else
+            memset(applied, 0, sizeof(*applied));
+        *restack = TRUE;
+    }
+
+    placement.hwnd = swap_hwnd;
+    placement.parent = target_hwnd;
+    placement.x = (int)work->item.offset_x;
+    placement.y = (int)work->item.offset_y;
+    placement.width = desc.BufferDesc.Width;
+    placement.height = desc.BufferDesc.Height;
+    if (!placement.width || !placement.height)
+    {
+        GetClientRect(target_hwnd, &rect);
+        placement.width = rect.right - rect.left;
+        placement.height = rect.bottom - rect.top;
+    }
+    placement.flags = SWP_NOZORDER | SWP_NOACTIVATE;
+    placement.target = work->target;
+    placement.plane = work->index;
+
+    if (!*restack && applied->swap_hwnd == swap_hwnd && applied->parent == target_hwnd
+            && applied->x == placement.x && applied->y == placement.y
+            && applied->width == placement.width && applied->height == placement.height)
+        return FALSE;
+
+    if (*restack)
+        placement.flags &= ~SWP_NOZORDER;
+
+    if (applied->swap_hwnd != swap_hwnd || applied->parent != target_hwnd)
+    {
+        LONG style = GetWindowLongW(swap_hwnd, GWL_STYLE);
+
+        if (applied->swap_hwnd != swap_hwnd)
+        {
+            /* Adopted now; remember what to restore when retired. */
+            applied->orig_parent = GetAncestor(swap_hwnd, GA_PARENT);
+            /* The target itself if a retirement is still on its way. */
+            if (applied->orig_parent == GetDesktopWindow() || applied->orig_parent == target_hwnd)
+                applied->orig_parent = NULL;
+            applied->orig_style = style;
+        }
+        applied->style = (style & ~WS_POPUP) | WS_CHILD | WS_VISIBLE;
+        placement.reparent = TRUE;
+        if (applied->style != style)
+        {
+            placement.style = applied->style;
+            placement.flags |= SWP_FRAMECHANGED;
+        }
+        placement.flags |= SWP_SHOWWINDOW;
+    }
+
+    TRACE("queueing swap hwnd %p at (%d,%d) %dx%d in target hwnd %p%s\n", swap_hwnd, placement.x, placement.y,
+            placement.width, placement.height, target_hwnd, placement.reparent ? ", reparenting" : "");
+    if (!queue_window_placement(device, &placement))
+    {
+        /* Nothing was queued; try again from scratch next pass. */
+        memset(applied, 0, sizeof(*applied));
+        return FALSE;
+    }
+
+    applied->swap_hwnd = swap_hwnd;
+    applied->parent = target_hwnd;
+    applied->x = placement.x;
+    applied->y = placement.y;
+    applied->width = placement.width;
+    applied->height = placement.height;
+    return TRUE;
+}
+
+static void overlay_track_target(struct composition_device *device, struct composition_target *target, BOOL track)
+{
+    if (track == target->overlay_tracked)
+        return;
+
+    if (track)
+    {
+        target_internal_addref(target);
+        list_add_tail(&device->overlay_targets, &target->overlay_entry);
+    }
+    else
+    {
+        list_remove(&target->overlay_entry);
+    }
+    target->overlay_tracked = track;
+    if (!track)
+        target_internal_release(target);
+}
+
+static BOOL target_has_planes(const struct composition_target *target)
+{
+    SIZE_T i;
+
+    for (i = 0; i < target->applied_count; i++)
+    {
+        if (target->applied[i].swap_hwnd)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Bring a target's planes in line with its run of frame entries: place the
+ * window of every content visual from first on, then retire the windows that
+ * no plane of the target shows any more. The entries below first are blended
+ * instead, see blend.c. pass identifies the composition pass.
+ * Returns the number of planes changed. */
+unsigned int overlay_target(struct composition_device *device, const struct composite_snapshot *entries,
+        unsigned int count, unsigned int first, UINT64 pass)
+{
+    struct composition_target *target = entries[0].target;
+    SIZE_T old_count = target->applied_count, i;
+    struct composition_target_placement *old;
+    unsigned int n = 0;
+    BOOL restack = FALSE;
+
+    if (!dcomp_array_reserve((void **)&device->overlay_planes, &device->overlay_planes_size,
+            old_count, sizeof(*device->overlay_planes)))
+    {
+        ERR("Failed to track the planes of target %p.\n", target);
+        return 0;
+    }
+    old = device->overlay_planes;
+    if (old_count)
+        memcpy(old, target->applied, old_count * sizeof(*old));
+
+    for (i = 0; i < count; i++)
+    {
+        if (i < first)
+        {
+            if (i < target->applied_count)
+                memset(&target->applied[i], 0, sizeof(target->applied[i]));
+            continue;
+        }
+        if (place_plane(device, &entries[i], old, old_count, &restack))
+            n++;
+    }
+    /* Planes past the end of the draw list are rebuilt if it grows again. */
+    target->applied_count = min(target->applied_count, count);
+
+    for (i = 0; i < old_count; i++)
+    {
+        if (old[i].swap_hwnd && !find_plane(target->applied, target->applied_count, old[i].swap_hwnd))
+        {
+            retire_plane(device, &old[i]);
+            n++;
+        }
+    }
+
+    target->overlay_pass = pass;
+    overlay_track_target(device, target, first || target_has_planes(target));
+    return n;
+}
+
+static void retire_target_planes(struct composition_device *device, struct composition_target *target)
+{
+    SIZE_T i;
+
+    for (i = 0; i < target->applied_count; i++)
+    {
+        if (target->applied[i].swap_hwnd)
+            retire_plane(device, &target->applied[i]);
+    }
+    target->applied_count = 0;
+    /* The blended part goes too, and is redrawn in full if it comes back. */
+    blend_window_show(device, target, FALSE);
+    target->path = COMPOSITION_PATH_NONE;
+    overlay_track_target(device, target, FALSE);
+}
+
+/* What the path selection needs to know about one content visual. */
+struct overlay_candidate
+{
+    RECT rect;              /* in target coordinates */
+    BOOL valid;
+    BOOL direct;            /* presents into the target window itself */
+};
+
+static const char *debugstr_composition_path(enum composition_path path)
+{
+    static const char *names[] = {"none", "overlay", "blend", "mixed"};
+
+    return path < ARRAY_SIZE(names) ? names[path] : wine_dbg_sprintf("%#x", path);
+}
+
+/* Properties a window cannot express. */
+static BOOL item_needs_blend(const struct draw_item *item)
+{
+    if (item->opacity < 1.0f)
+        return TRUE;
+    if (!draw_item_is_translation(item))
+        return TRUE;
+    return item->clip.left > -FLT_MAX || item->clip.top > -FLT_MAX
+            || item->clip.right < FLT_MAX || item->clip.bottom < FLT_MAX;
+}
+
+/* Classify one content visual; returns TRUE if it can only be blended. */
+static BOOL classify_entry(struct composition_target *target, const struct composite_snapshot *work,
+        const struct overlay_candidate *below, unsigned int below_count, struct overlay_candidate *candidate)
+{
+    DXGI_SWAP_CHAIN_DESC1 desc1;
+    IDXGISwapChain1 *swapchain;
+    DXGI_SWAP_CHAIN_DESC desc;
+    BOOL needs_blend;
+    unsigned int i;
+    RECT overlap;
+    HRESULT hr;
+
+    memset(candidate, 0, sizeof(*candidate));
+    if (FAILED(IUnknown_QueryInterface(work->item.content, &IID_IDXGISwapChain1, (void **)&swapchain)))
+        return FALSE;
+    hr = IDXGISwapChain1_GetDesc(swapchain, &desc);
+    if (SUCCEEDED(hr))
+        hr = IDXGISwapChain1_GetDesc1(swapchain, &desc1);
+    IDXGISwapChain1_Release(swapchain);
+    if (FAILED(hr))
+        return FALSE;
+
+    candidate->valid = TRUE;
+    candidate->direct = desc.OutputWindow == target->hwnd;
+    draw_item_bounds(&work->item, desc1.Width, desc1.Height, &candidate->rect);
+
+    /* Without a window of its own, content can only be blended. */
+    if (!candidate->direct && (!desc.OutputWindow || !IsWindow(desc.OutputWindow)))
+        return TRUE;
+    if (item_needs_blend(&work->item))
+        return TRUE;
+    if (desc1.AlphaMode != DXGI_ALPHA_MODE_PREMULTIPLIED && desc1.AlphaMode != DXGI_ALPHA_MODE_STRAIGHT)
+        return FALSE;
+
+    /* Translucent content only needs blending over other content. */
+    needs_blend = FALSE;
+    for (i = 0; i < below_count && !needs_blend; i++)
+        needs_blend = below[i].valid && IntersectRect(&overlap, &below[i].rect, &candidate->rect);
+    return needs_blend;
+}
+
+/* Choose how to composite a target's run of frame entries, and return how
+ * many of them, from the bottom, are to be blended; the others are shown as
+ * overlay planes.
+ *
+ * Planes are child windows stacked above the window showing the blended
+ * result, so the blended entries have to be a prefix of the z-order: the
+ * highest entry that cannot be a plane and everything below it. Content
+ * presenting straight into the target window would be covered by that
+ * window, and content that cannot be read back safely cannot be blended at
+ * all, so such targets stay with overlays. */
+unsigned int select_composition_path(struct composition_device *device, const struct composite_snapshot *entries,
+        unsigned int count)
+{
+    struct composition_target *target = entries[0].target;
+    struct overlay_candidate *candidates;
+    unsigned int i, blend_count = 0;
+    enum composition_path path;
+    BOOL direct = FALSE;
+    RECT rect;
+
+    switch (device->mode)
+    {
+        case COMPOSITION_MODE_OVERLAY:
+            break;
+
+        case COMPOSITION_MODE_BLEND:
+            blend_count = count;
+            break;
+
+        case COMPOSITION_MODE_ADAPTIVE:
+            if (!dcomp_array_reserve((void **)&device->overlay_candidates, &device->overlay_candidates_size,
+                    count, sizeof(*device->overlay_candidates)))
+                break;
+            candidates = device->overlay_candidates;
+            for (i = 0; i < count; i++)
+            {
+                if (classify_entry(target, &entries[i], candidates, i, &candidates[i]))
+                    blend_count = i + 1;
+                direct |= candidates[i].direct;
+            }
+            if (blend_count && direct)
+            {
+                if (!target->direct_warned)
+                    FIXME("Target hwnd %p needs blending but has content presenting to it directly.\n",
+                            target->hwnd);
+                target->direct_warned = TRUE;
+                blend_count = 0;
+            }
+            break;
+    }
+
+    for (i = 0; i < blend_count; i++)
+    {
+        if (!blend_content_readable(entries[i].item.content))
+        {
+            if (!target->readback_warned)
+                WARN("Target hwnd %p needs blending but content %p cannot be read back.\n",
+                        target->hwnd, entries[i].item.content);
+            target->readback_warned = TRUE;
+            blend_count = 0;
+        }
+    }
+
+    if (!blend_count)
+        path = COMPOSITION_PATH_OVERLAY;
+    else if (blend_count == count)
+        path = COMPOSITION_PATH_BLEND;
+    else
+        path = COMPOSITION_PATH_MIXED;
+
+    /* Blending resumes from a window that was hidden meanwhile. */
+    target->blend_reset = target->path != COMPOSITION_PATH_BLEND && target->path != COMPOSITION_PATH_MIXED;
+    if (path != target->path)
+    {
+        TRACE("target %p hwnd %p switches from %s to %s composition, %u of %u visual(s) blended\n",
+                target, target->hwnd, debugstr_composition_path(target->path), debugstr_composition_path(path),
+                blend_count, count);
+        target->path = path;
+    }
+    if (blend_count)
+    {
+        GetClientRect(target->hwnd, &rect);
+        target->client_width = rect.right - rect.left;
+        target->client_height = rect.bottom - rect.top;
+    }
+    blend_window_show(device, target, blend_count != 0);
+    target->blend_count = blend_count;
+    return blend_count;
+}
+
+/* Retire the planes, and hide the blended result, of every target that was
+ * not part of pass, because its tree lost all content or the target was
+ * released. */
+void overlay_retire_targets(struct composition_device *device, UINT64 pass)
+{
+    struct composition_target *target, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE(target, next, &device->overlay_targets, struct composition_target, overlay_entry)
+    {
+        if (target->overlay_pass != pass)
+            retire_target_planes(device, target);
+    }
+}
+
+/* Called when a placement queued by place_plane() or blend_window_show()
+ * could not be handed to the window's owner. The plane's state is then
+ * unknown, so make the next pass queue it again: from scratch if the window
+ * was being adopted, as when queueing fails, and otherwise by forgetting its
+ * geometry. A blend window is created by the next pass that blends. */
+void overlay_placement_lost(const struct window_placement *placement)
+{
+    struct composition_target *target = placement->target;
+    struct composition_target_placement *applied;
+
+    if (placement->blend_window)
+    {
+        blend_window_placement_lost(placement);
+        return;
+    }
+    if (!target || placement->plane >= target->applied_count)
+        return;
+    applied = &target->applied[placement->plane];
+    if (applied->swap_hwnd != placement->hwnd)
+        return;
+
+    if (placement->reparent)
+        memset(applied, 0, sizeof(*applied));
+    else
+        applied->width = applied->height = -1;
+}
+
+/* Hand every plane back when the device goes away. Called from Release once
+ * the compositor thread has exited. */
+void overlay_cleanup(struct composition_device *device)
+{
+    struct composition_target *target, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE(target, next, &device->overlay_targets, struct composition_target, overlay_entry)
+        retire_target_planes(device, target);
+    flush_window_placements(device);
+    free(device->overlay_planes);
+    free(device->overlay_candidates);
+}
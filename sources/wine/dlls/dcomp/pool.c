@@ -0,0 +1,114 @@
+/*
+ * Copyright 2026 Porthole contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#include <stdarg.h>
+#include <string.h>
+#include <malloc.h>
+
+#define COBJMACROS
+#include "windef.h"
+#include "winbase.h"
+#include "dcomp_private.h"
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(dcomp);
+
+/* Fixed-size object pools. Objects are carved out of slabs and returned to a
+ * lock-free free list when released, so create/release churn reuses memory
+ * in place and live objects of one type stay close together. Objects may be
+ * freed from any thread, including the compositor; only growing the pool
+ * takes a lock. Slabs are returned to the system when the device is
+ * destroyed. */
+
+struct pool_slab
+{
+    struct list entry;
+};
+
+#define POOL_ALIGN(size) (((size) + MEMORY_ALLOCATION_ALIGNMENT - 1) & ~(SIZE_T)(MEMORY_ALLOCATION_ALIGNMENT - 1))
+
+static SIZE_T pool_slab_header_size(void)
+{
+    return POOL_ALIGN(sizeof(struct pool_slab));
+}
+
+void object_pool_init(struct object_pool *pool, SIZE_T object_size, unsigned int objects_per_slab)
+{
+    InitializeSListHead(&pool->free_list);
+    InitializeSRWLock(&pool->lock);
+    list_init(&pool->slabs);
+    pool->object_size = POOL_ALIGN(max(object_size, sizeof(SLIST_ENTRY)));
+    pool->objects_per_slab = objects_per_slab;
+}
+
+/* Called with the pool lock held. Returns the first object of a new slab and
+ * puts the others on the free list. */
+static SLIST_ENTRY *object_pool_grow(struct object_pool *pool)
+{
+    struct pool_slab *slab;
+    BYTE *objects;
+    unsigned int i;
+
+    if (!(slab = _aligned_malloc(pool_slab_header_size() + pool->objects_per_slab * pool->object_size,
+            MEMORY_ALLOCATION_ALIGNMENT)))
+        return NULL;
+    list_add_tail(&pool->slabs, &slab->entry);
+    objects = (BYTE *)slab + pool_slab_header_size();
+
+    /* Push in reverse so that objects are handed out in address order. */
+    for (i = pool->objects_per_slab - 1; i > 0; i--)
+        InterlockedPushEntrySList(&pool->free_list, (SLIST_ENTRY *)(objects + i * pool->object_size));
+
+    TRACE("pool %p grew by %u objects of %Iu bytes\n", pool, pool->objects_per_slab, pool->object_size);
+    return (SLIST_ENTRY *)objects;
+}
+
+/* Returns a zeroed object, or NULL if out of memory. */
+void *object_pool_alloc(struct object_pool *pool)
+{
+    SLIST_ENTRY *entry;
+
+    if (!(entry = InterlockedPopEntrySList(&pool->free_list)))
+    {
+        AcquireSRWLockExclusive(&pool->lock);
+        /* Another thread may have grown the pool while we waited. */
+        if (!(entry = InterlockedPopEntrySList(&pool->free_list)))
+            entry = object_pool_grow(pool);
+        ReleaseSRWLockExclusive(&pool->lock);
+        if (!entry)
+            return NULL;
+    }
+
+    memset(entry, 0, pool->object_size);
+    return entry;
+}
+
+void object_pool_free(struct object_pool *pool, void *object)
+{
+    InterlockedPushEntrySList(&pool->free_list, object);
+}
+
+/* Release every slab. All objects must have been freed. */
+void object_pool_cleanup(struct object_pool *pool)
+{
+    struct pool_slab *slab, *next;
+
+    LIST_FOR_EACH_ENTRY_SAFE(slab, next, &pool->slabs, struct pool_slab, entry)
+        _aligned_free(slab);
+    list_init(&pool->slabs);
+    InitializeSListHead(&pool->free_list);
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright 2026 Porthole contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COBJMACROS
+#include "windef.h"
+#include "winbase.h"
+#include "dcomp_private.h"
+#include "wine/debug.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+WINE_DEFAULT_DEBUG_CHANNEL(dcomp);
+
+#ifndef PF_AVX2_INSTRUCTIONS_AVAILABLE
+#define PF_AVX2_INSTRUCTIONS_AVAILABLE 40
+#endif
+
+/* Composition properties of every visual of a device, stored as parallel
+ * arrays indexed by the visual's slot. Slot 0 is a virtual root with an
+ * identity world transform that parentless visuals point to.
+ *
+ * Slots are kept in breadth-first order of the visual forest, so every
+ * parent precedes its children and each depth level is a contiguous run of
+ * slots. World transforms are then evaluated level by level in a single pass
+ * over the arrays, several visuals at a time, without following any visual
+ * pointer. Structural changes only flag the order as stale; it is rebuilt
+ * at the next evaluation. All of this is done under the device lock.
+ *
+ * A visual's own transform is its transform matrix followed by its offset.
+ * World transforms are cached; a change re-evaluates the changed visual's
+ * level and the ones below it, and leaves the levels above alone. As long
+ * as no visual has a transform that does more than translate, which is the
+ * common case, only the translations are accumulated, eight visuals at a
+ * time where AVX2 can gather the parents' translations; otherwise every
+ * level goes through the full matrix product. */
+
+typedef void (*evaluate_level_func)(struct visual_properties *props, SIZE_T start, SIZE_T end);
+
+static const struct visual_linear identity_linear = {1.0f, 0.0f, 0.0f, 1.0f};
+
+static inline BOOL linear_is_identity(const struct visual_linear *linear)
+{
+    return linear->_11 == 1.0f && linear->_12 == 0.0f && linear->_21 == 0.0f && linear->_22 == 1.0f;
+}
+
+static void evaluate_level(struct visual_properties *props, SIZE_T start, SIZE_T end)
+{
+    SIZE_T i;
+
+    for (i = start; i < end; i++)
+    {
+        props->world_x[i] = props->offset_x[i] + props->transform_x[i] + props->world_x[props->parent[i]];
+        props->world_y[i] = props->offset_y[i] + props->transform_y[i] + props->world_y[props->parent[i]];
+    }
+}
+
+/* The full product with the parent's world transform, in D2D row-vector
+ * order: world = own * parent. */
+static void evaluate_level_linear(struct visual_properties *props, SIZE_T start, SIZE_T end)
+{
+    const struct visual_linear *own, *parent;
+    struct visual_linear *world;
+    float x, y;
+    UINT32 p;
+    SIZE_T i;
+
+    for (i = start; i < end; i++)
+    {
+        p = props->parent[i];
+        own = &props->linear[i];
+        parent = &props->world_linear[p];
+        world = &props->world_linear[i];
+        x = props->offset_x[i] + props->transform_x[i];
+        y = props->offset_y[i] + props->transform_y[i];
+        props->world_x[i] = x * parent->_11 + y * parent->_21 + props->world_x[p];
+        props->world_y[i] = x * parent->_12 + y * parent->_22 + props->world_y[p];
+        world->_11 = own->_11 * parent->_11 + own->_12 * parent->_21;
+        world->_12 = own->_11 * parent->_12 + own->_12 * parent->_22;
+        world->_21 = own->_21 * parent->_11 + own->_22 * parent->_21;
+        world->_22 = own->_21 * parent->_12 + own->_22 * parent->_22;
+    }
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+
+__attribute__((target("avx2")))
+static void evaluate_level_avx2(struct visual_properties *props, SIZE_T start, SIZE_T end)
+{
+    SIZE_T i = start;
+    __m256i index;
+    __m256 x, y;
+
+    for (; i + 8 <= end; i += 8)
+    {
+        index = _mm256_loadu_si256((const __m256i *)&props->parent[i]);
+        x = _mm256_add_ps(_mm256_loadu_ps(&props->offset_x[i]), _mm256_loadu_ps(&props->transform_x[i]));
+        y = _mm256_add_ps(_mm256_loadu_ps(&props->offset_y[i]), _mm256_loadu_ps(&props->transform_y[i]));
+        _mm256_storeu_ps(&props->world_x[i],
+                _mm256_add_ps(x, _mm256_i32gather_ps(props->world_x, index, sizeof(float))));
+        _mm256_storeu_ps(&props->world_y[i],
+                _mm256_add_ps(y, _mm256_i32gather_ps(props->world_y, index, sizeof(float))));
+    }
+    evaluate_level(props, i, end);
+}
+
+#endif
+
+static evaluate_level_func select_evaluate_level(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    if (IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE))
+        return evaluate_level_avx2;
+#endif
+    return evaluate_level;
+}
+
+static BOOL resize_array(void **array, SIZE_T size, SIZE_T element_size)
+{
+    void *new_array;
+
+    if (!(new_array = realloc(*array, size * element_size)))
+        return FALSE;
+    *array = new_array;
+    return TRUE;
+}
+
+static BOOL visual_properties_reserve(struct visual_properties *props, SIZE_T count)
+{
+    SIZE_T size;
+
+    if (count <= props->size)
+        return TRUE;
+
+    size = max(64, props->size * 2);
+    while (size < count)
+        size *= 2;
+
+    /* Arrays that did grow are simply larger than needed on failure. */
+    if (!resize_array((void **)&props->visuals, size, sizeof(*props->visuals))
+            || !resize_array((void **)&props->parent, size, sizeof(*props->parent))
+            || !resize_array((void **)&props->offset_x, size, sizeof(*props->offset_x))
+            || !resize_array((void **)&props->offset_y, size, sizeof(*props->offset_y))
+            || !resize_array((void **)&props->transform_x, size, sizeof(*props->transform_x))
+            || !resize_array((void **)&props->transform_y, size, sizeof(*props->transform_y))
+            || !resize_array((void **)&props->linear, size, sizeof(*props->linear))
+            || !resize_array((void **)&props->world_x, size, sizeof(*props->world_x))
+            || !resize_array((void **)&props->world_y, size, sizeof(*props->world_y))
+            || !resize_array((void **)&props->world_linear, size, sizeof(*props->world_linear))
+            || !resize_array((void **)&props->levels, size + 1, sizeof(*props->levels))
+            || !resize_array((void **)&props->order, size, sizeof(*props->order)))
+        return FALSE;
+
+    props->size = size;
+    return TRUE;
+}
+
+static void visual_properties_init_slot(struct visual_properties *props, SIZE_T slot)
+{
+    props->parent[slot] = 0;
+    props->offset_x[slot] = props->offset_y[slot] = 0.0f;
+    props->transform_x[slot] = props->transform_y[slot] = 0.0f;
+    props->linear[slot] = identity_linear;
+    props->world_x[slot] = props->world_y[slot] = 0.0f;
+    props->world_linear[slot] = identity_linear;
+}
+
+/* Give a new visual a slot. Called with the device lock held. */
+BOOL visual_properties_add(struct visual_properties *props, struct composition_visual *visual)
+{
+    if (!visual_properties_reserve(props, max(props->count, 1) + 1))
+        return FALSE;
+
+    if (!props->count)
+    {
+        props->visuals[0] = NULL;
+        visual_properties_init_slot(props, 0);
+        props->count = 1;
+    }
+
+    visual->slot = props->count++;
+    props->visuals[visual->slot] = visual;
+    visual_properties_init_slot(props, visual->slot);
+    props->order_dirty = TRUE;
+    return TRUE;
+}
+
+/* Release a visual's slot by moving the last slot into it. Called with the
+ * device lock held, once the visual has no parent and no children. */
+void visual_properties_remove(struct visual_properties *props, struct composition_visual *visual)
+{
+    SIZE_T last = props->count - 1;
+
+    if (!linear_is_identity(&props->linear[visual->slot]))
+        props->linear_count--;
+
+    if (visual->slot != last)
+    {
+        props->visuals[visual->slot] = props->visuals[last];
+        props->offset_x[visual->slot] = props->offset_x[last];
+        props->offset_y[visual->slot] = props->offset_y[last];
+        props->transform_x[visual->slot] = props->transform_x[last];
+        props->transform_y[visual->slot] = props->transform_y[last];
+        props->linear[visual->slot] = props->linear[last];
+        props->visuals[visual->slot]->slot = visual->slot;
+    }
+    props->count--;
+    props->order_dirty = TRUE;
+}
+
+/* Re-sort the slots breadth-first over the visual forest. */
+static void visual_properties_sort(struct visual_properties *props)
+{
+    struct composition_visual *visual, *child;
+    SIZE_T i, n = 1, start, end;
+
+    /* Parentless visuals, target roots or not, form the first level. */
+    for (i = 1; i < props->count; i++)
+    {
+        if (!props->visuals[i]->parent)
+            props->order[n++] = props->visuals[i];
+    }
+
+    props->level_count = 0;
+    for (start = 1, end = n; start < end; start = end, end = n)
+    {
+        props->levels[props->level_count++] = start;
+        for (i = start; i < end; i++)
+        {
+            LIST_FOR_EACH_ENTRY(child, &props->order[i]->children, struct composition_visual, entry)
+                props->order[n++] = child;
+        }
+    }
+    props->levels[props->level_count] = end;
+
+    /* Permute local properties into the new order; world values are
+     * recomputed anyway, so the world arrays serve as scratch space here. */
+    for (i = 1; i < n; i++)
+    {
+        props->world_x[i] = props->offset_x[props->order[i]->slot];
+        props->world_y[i] = props->offset_y[props->order[i]->slot];
+        props->world_linear[i] = props->linear[props->order[i]->slot];
+    }
+    for (i = 1; i < n; i++)
+    {
+        props->offset_x[i] = props->world_x[i];
+        props->offset_y[i] = props->world_y[i];
+        props->linear[i] = props->world_linear[i];
+    }
+    for (i = 1; i < n; i++)
+    {
+        props->world_x[i] = props->transform_x[props->order[i]->slot];
+        props->world_y[i] = props->transform_y[props->order[i]->slot];
+    }
+    for (i = 1; i < n; i++)
+    {
+        visual = props->order[i];
+        visual->slot = i;
+        props->visuals[i] = visual;
+        props->transform_x[i] = props->world_x[i];
+        props->transform_y[i] = props->world_y[i];
+    }
+    for (i = 1; i < n; i++)
+    {
+        visual = props->visuals[i];
+        props->parent[i] = visual->parent ? visual->parent->slot : 0;
+    }
+
+    props->order_dirty = FALSE;
+    props->dirty_level = 0;
+    TRACE("sorted %Iu visual(s) into %Iu level(s)\n", n - 1, props->level_count);
+}
+
+/* Note that the visual in slot changed, so that its level and the ones
+ * below it are re-evaluated. Called with the device lock held. */
+void visual_properties_invalidate(struct visual_properties *props, UINT32 slot)
+{
+    SIZE_T low = 0, high = props->level_count, mid;
+
+    props->world_dirty = TRUE;
+    /* A stale order is re-evaluated from the top anyway. */
+    if (props->order_dirty)
+        return;
+
+    while (high - low > 1)
+    {
+        mid = (low + high) / 2;
+        if (props->levels[mid] <= slot)
+            low = mid;
+        else
+            high = mid;
+    }
+    props->dirty_level = min(props->dirty_level, low);
+}
+
+/* Set the transform matrix of the visual in slot. Returns FALSE if it did not
+ * change. Called with the device lock held. */
+BOOL visual_properties_set_transform(struct visual_properties *props, UINT32 slot, const D2D_MATRIX_3X2_F *matrix)
+{
+    struct visual_linear linear = {matrix->_11, matrix->_12, matrix->_21, matrix->_22};
+    BOOL was_translation = linear_is_identity(&props->linear[slot]);
+
+    if (!memcmp(&props->linear[slot], &linear, sizeof(linear))
+            && props->transform_x[slot] == matrix->_31 && props->transform_y[slot] == matrix->_32)
+        return FALSE;
+
+    props->linear[slot] = linear;
+    props->transform_x[slot] = matrix->_31;
+    props->transform_y[slot] = matrix->_32;
+    visual_properties_invalidate(props, slot);
+
+    if (was_translation && !linear_is_identity(&linear))
+    {
+        /* World linear parts are not kept up while everything translates. */
+        if (!props->linear_count++)
+            props->dirty_level = 0;
+    }
+    else if (!was_translation && linear_is_identity(&linear))
+    {
+        props->linear_count--;
+    }
+    return TRUE;
+}
+
+/* The transform from the visual in slot to its root's coordinates. World
+ * properties must be up to date. */
+void visual_properties_world_transform(const struct visual_properties *props, UINT32 slot,
+        D2D_MATRIX_3X2_F *matrix)
+{
+    const struct visual_linear *linear = props->linear_count ? &props->world_linear[slot] : &identity_linear;
+
+    matrix->_11 = linear->_11;
+    matrix->_12 = linear->_12;
+    matrix->_21 = linear->_21;
+    matrix->_22 = linear->_22;
+    matrix->_31 = props->world_x[slot];
+    matrix->_32 = props->world_y[slot];
+}
+
+/* The transform from the visual in slot to its parent's coordinates: its
+ * transform, then its offset. */
+void visual_properties_local_transform(const struct visual_properties *props, UINT32 slot,
+        D2D_MATRIX_3X2_F *matrix)
+{
+    const struct visual_linear *linear = &props->linear[slot];
+
+    matrix->_11 = linear->_11;
+    matrix->_12 = linear->_12;
+    matrix->_21 = linear->_21;
+    matrix->_22 = linear->_22;
+    matrix->_31 = props->offset_x[slot] + props->transform_x[slot];
+    matrix->_32 = props->offset_y[slot] + props->transform_y[slot];
+}
+
+/* Bring world transforms up to date. Called with the device lock held. */
+void visual_properties_update(struct visual_properties *props)
+{
+    static evaluate_level_func evaluate_translation;
+    evaluate_level_func evaluate;
+    SIZE_T i;
+
+    if (!props->order_dirty && !props->world_dirty)
+        return;
+
+    if (!evaluate_translation)
+        evaluate_translation = select_evaluate_level();
+
+    if (props->order_dirty)
+        visual_properties_sort(props);
+
+    evaluate = props->linear_count ? evaluate_level_linear : evaluate_translation;
+    for (i = props->dirty_level; i < props->level_count; i++)
+        evaluate(props, props->levels[i], props->levels[i + 1]);
+    props->dirty_level = props->level_count;
+    props->world_dirty = FALSE;
+}
+
+void visual_properties_cleanup(struct visual_properties *props)
+{
+    free(props->visuals);
+    free(props->parent);
+    free(props->offset_x);
+    free(props->offset_y);
+    free(props->transform_x);
+    free(props->transform_y);
+    free(props->linear);
+    free(props->world_x);
+    free(props->world_y);
+    free(props->world_linear);
+    free(props->levels);
+    free(props->order);
+}
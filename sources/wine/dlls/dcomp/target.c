@@ -27,6 +27,60 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(dcomp);
 
+int compare_target_hwnd(const void *key, const struct wine_rb_entry *entry)
+{
+    const struct composition_target *target = WINE_RB_ENTRY_VALUE(entry, const struct composition_target, tree_entry);
+    HWND hwnd = (HWND)key;
+
+    if (hwnd > target->hwnd)
+        return 1;
+    if (hwnd < target->hwnd)
+        return -1;
+    return 0;
+}
+
+/* Queue the target for re-evaluation at the next Commit. Called with the device lock held. */
+void target_mark_dirty(struct composition_target *target)
+{
+    struct composition_device *device = impl_from_IDCompositionDevice(target->device);
+
+    if (target->dirty)
+        return;
+
+    target->dirty = TRUE;
+    list_add_tail(&device->dirty_targets, &target->dirty_entry);
+}
+
+/* Frames handed to the compositor keep the target's memory alive, but not
+ * the device, after the application has released it. */
+void target_internal_addref(struct composition_target *target)
+{
+    InterlockedIncrement(&target->internal_ref);
+}
+
+void target_internal_release(struct composition_target *target)
+{
+    struct composition_device *device = impl_from_IDCompositionDevice(target->device);
+    SIZE_T i;
+
+    if (!InterlockedDecrement(&target->internal_ref))
+    {
+        for (i = 0; i < target->blend_staging_count; i++)
+        {
+            if (target->blend_staging[i])
+                ID3D11Texture2D_Release(target->blend_staging[i]);
+        }
+        free(target->blend_staging);
+        free(target->applied);
+        free(target->blend_bits);
+        free(target->tile_hashes);
+        free(target->dirty_tiles);
+        free(target->blend_sources);
+        blend_window_destroy(target->blend_window);
+        object_pool_free(&device->target_pool, target);
+    }
+}
+
 static HRESULT STDMETHODCALLTYPE target_QueryInterface(IDCompositionTarget *iface, REFIID iid, void **out)
 {
     TRACE("iface %p, iid %s, out %p\n", iface, debugstr_guid(iid), out);
@@ -66,16 +120,26 @@ static ULONG STDMETHODCALLTYPE target_Release(IDCompositionTarget *iface)
         struct composition_device *device = impl_from_IDCompositionDevice(target->device);
 
         EnterCriticalSection(&device->cs);
-        list_remove(&target->entry);
-        LeaveCriticalSection(&device->cs);
-        IDCompositionDevice_Release(target->device);
+        wine_rb_remove(&device->target_tree, &target->tree_entry);
+        if (target->active)
+        {
+            list_remove(&target->active_entry);
+            device->active_count--;
+        }
+        if (target->dirty)
+            list_remove(&target->dirty_entry);
         if (target->root)
         {
             root_visual = impl_from_IDCompositionVisual(target->root);
-            root_visual->is_root = FALSE;
+            root_visual->target = NULL;
             IDCompositionVisual_Release(target->root);
         }
-        free(target);
+        free(target->content_visuals);
+        free(target->draw_list);
+        LeaveCriticalSection(&device->cs);
+        /* The target's memory belongs to the device, so drop it first. */
+        target_internal_release(target);
+        IDCompositionDevice_Release(&device->IDCompositionDevice_iface);
     }
 
     return ref;
@@ -85,27 +149,36 @@ static HRESULT STDMETHODCALLTYPE target_SetRoot(IDCompositionTarget *iface,
         IDCompositionVisual *visual)
 {
     struct composition_target *target = impl_from_IDCompositionTarget(iface);
+    struct composition_device *device = impl_from_IDCompositionDevice(target->device);
     struct composition_visual *composition_visual;
 
     TRACE("iface %p, visual %p\n", iface, visual);
 
+    EnterCriticalSection(&device->cs);
     if (visual)
     {
         composition_visual = impl_from_IDCompositionVisual(visual);
-        if (composition_visual->is_root)
+        /* A root belongs to a single target and has no parent. */
+        if (composition_visual->device != device || composition_visual->target || composition_visual->parent)
+        {
+            LeaveCriticalSection(&device->cs);
             return E_INVALIDARG;
+        }
 
-        composition_visual->is_root = TRUE;
+        composition_visual->target = target;
         IDCompositionVisual_AddRef(visual);
     }
 
     if (target->root)
     {
         composition_visual = impl_from_IDCompositionVisual(target->root);
-        composition_visual->is_root = FALSE;
+        composition_visual->target = NULL;
         IDCompositionVisual_Release(target->root);
     }
     target->root = visual;
+    target->index_dirty = TRUE;
+    target_mark_dirty(target);
+    LeaveCriticalSection(&device->cs);
     return S_OK;
 }
 
@@ -130,19 +203,28 @@ HRESULT create_target(struct composition_device *device, HWND hwnd, BOOL topmost
     if (!IsWindow(hwnd))
         return E_INVALIDARG;
 
-    target = calloc(1, sizeof(*target));
+    target = object_pool_alloc(&device->target_pool);
     if (!target)
         return E_OUTOFMEMORY;
 
-    IDCompositionDevice_AddRef(&device->IDCompositionDevice_iface);
-    EnterCriticalSection(&device->cs);
-    list_add_tail(&device->targets, &target->entry);
-    LeaveCriticalSection(&device->cs);
     target->IDCompositionTarget_iface.lpVtbl = &target_vtbl;
     target->ref = 1;
+    target->internal_ref = 1;
     target->hwnd = hwnd;
     target->topmost = topmost;
     target->device = &device->IDCompositionDevice_iface;
+
+    EnterCriticalSection(&device->cs);
+    if (wine_rb_put(&device->target_tree, hwnd, &target->tree_entry) == -1)
+    {
+        LeaveCriticalSection(&device->cs);
+        WARN("hwnd %p already has a composition target.\n", hwnd);
+        object_pool_free(&device->target_pool, target);
+        return DCOMPOSITION_ERROR_WINDOW_ALREADY_COMPOSED;
+    }
+    LeaveCriticalSection(&device->cs);
+
+    IDCompositionDevice_AddRef(&device->IDCompositionDevice_iface);
     *new_target = &target->IDCompositionTarget_iface;
 
     /* Tell CreateSwapChainForComposition which window to render into on this thread. */
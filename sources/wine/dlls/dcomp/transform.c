@@ -0,0 +1,690 @@
+/*
+ * Copyright 2026 Porthole contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#include <stdarg.h>
+#include <math.h>
+
+#define COBJMACROS
+#include "windef.h"
+#include "winbase.h"
+#include "dcomp_private.h"
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(dcomp);
+
+/* 2D transform objects. A transform is a handful of parameters, or for a
+ * group the transforms it was created from, and may be shared by any number
+ * of visuals and groups. Parameter setters queue a command like visual
+ * setters do, so changes take effect at the next Commit.
+ *
+ * Matrices are evaluated lazily and memoised. A change marks the transform
+ * and, through the groups containing it, every transform built on it dirty,
+ * and queues the visuals using any of them on device->transform_visuals;
+ * Commit then evaluates only what those visuals need. A dirty transform has
+ * dirty groups and queued visuals already, so a change stops there, and an
+ * update costs O(dependents). All of this is done under the device lock.
+ *
+ * Like visual offsets, parameters may be animated instead; the compositor
+ * then evaluates the transforms of the visuals using them on its own, from
+ * the parameters captured in the frame, see bind_animations(). */
+
+#define DEGREES_TO_RADIANS (3.14159265358979323846f / 180.0f)
+
+static const struct IDCompositionTranslateTransformVtbl translate_transform_vtbl;
+static const struct IDCompositionScaleTransformVtbl scale_transform_vtbl;
+static const struct IDCompositionRotateTransformVtbl rotate_transform_vtbl;
+static const struct IDCompositionSkewTransformVtbl skew_transform_vtbl;
+static const struct IDCompositionMatrixTransformVtbl matrix_transform_vtbl;
+static const struct IDCompositionTransformVtbl transform_group_vtbl;
+
+static inline struct composition_transform *impl_from_IDCompositionTransform(IDCompositionTransform *iface)
+{
+    return CONTAINING_RECORD(iface, struct composition_transform, IDCompositionTransform_iface);
+}
+
+/* Every transform interface starts with the IDCompositionTransform methods. */
+#define impl_from_transform_iface(iface) impl_from_IDCompositionTransform((IDCompositionTransform *)(iface))
+
+struct composition_transform *unsafe_impl_from_IDCompositionTransform(IDCompositionTransform *iface)
+{
+    const void *vtbl;
+
+    if (!iface)
+        return NULL;
+    vtbl = iface->lpVtbl;
+    if (vtbl != &translate_transform_vtbl && vtbl != &scale_transform_vtbl && vtbl != &rotate_transform_vtbl
+            && vtbl != &skew_transform_vtbl && vtbl != &matrix_transform_vtbl && vtbl != &transform_group_vtbl)
+        return NULL;
+    return impl_from_IDCompositionTransform(iface);
+}
+
+static void transform_invalidate(struct composition_transform *transform)
+{
+    struct composition_device *device = transform->device;
+    struct composition_visual *visual;
+    struct transform_link *link;
+
+    if (transform->dirty)
+        return;
+    transform->dirty = TRUE;
+
+    LIST_FOR_EACH_ENTRY(link, &transform->groups, struct transform_link, entry)
+        transform_invalidate(link->group);
+    LIST_FOR_EACH_ENTRY(visual, &transform->visuals, struct composition_visual, transform_entry)
+    {
+        if (visual->transform_pending)
+            continue;
+        visual->transform_pending = TRUE;
+        list_add_tail(&device->transform_visuals, &visual->transform_pending_entry);
+    }
+}
+
+/* Replace the animation of the index-th parameter, taking over the caller's
+ * reference to the new one, which may be NULL. An animation starts at its
+ * absolute begin time if it has one, and otherwise now, at the Commit
+ * applying it. Called with the device lock held. */
+void transform_set_animation(struct composition_transform *transform, unsigned int index,
+        struct animation_function *function)
+{
+    unsigned int was_animated = transform->animation_count;
+    LARGE_INTEGER now;
+
+    if (transform->animations[index])
+    {
+        animation_function_release(transform->animations[index]);
+        transform->animation_count--;
+    }
+    if ((transform->animations[index] = function))
+    {
+        QueryPerformanceCounter(&now);
+        transform->animation_begin[index] = function->begin_time ? function->begin_time : now.QuadPart;
+        transform->animation_count++;
+    }
+
+    if (transform->animation_count && !was_animated)
+        list_add_tail(&transform->device->animated_transforms, &transform->animation_entry);
+    else if (!transform->animation_count && was_animated)
+        list_remove(&transform->animation_entry);
+}
+
+/* Set count parameters from the first-th on. Called with the device lock held. */
+void transform_set_values(struct composition_transform *transform, unsigned int first, unsigned int count,
+        const float *values)
+{
+    unsigned int i;
+    BOOL changed = FALSE;
+
+    for (i = 0; i < count; i++)
+    {
+        /* A value replaces an animation. */
+        if (transform->animations[first + i])
+            transform_set_animation(transform, first + i, NULL);
+        if (transform->values[first + i] == values[i])
+            continue;
+        transform->values[first + i] = values[i];
+        changed = TRUE;
+    }
+    if (changed)
+        transform_invalidate(transform);
+}
+
+void multiply_matrix(D2D_MATRIX_3X2_F *out, const D2D_MATRIX_3X2_F *a, const D2D_MATRIX_3X2_F *b)
+{
+    D2D_MATRIX_3X2_F m;
+
+    m._11 = a->_11 * b->_11 + a->_12 * b->_21;
+    m._12 = a->_11 * b->_12 + a->_12 * b->_22;
+    m._21 = a->_21 * b->_11 + a->_22 * b->_21;
+    m._22 = a->_21 * b->_12 + a->_22 * b->_22;
+    m._31 = a->_31 * b->_11 + a->_32 * b->_21 + b->_31;
+    m._32 = a->_31 * b->_12 + a->_32 * b->_22 + b->_32;
+    *out = m;
+}
+
+/* The matrix of a transform of the given type, other than a group, with the
+ * given parameters. */
+void transform_matrix(enum transform_type type, const float *v, D2D_MATRIX_3X2_F *m)
+{
+    float s, c;
+
+    m->_11 = m->_22 = 1.0f;
+    m->_12 = m->_21 = m->_31 = m->_32 = 0.0f;
+    switch (type)
+    {
+        case TRANSFORM_TRANSLATE:
+            m->_31 = v[TRANSFORM_OFFSET_X];
+            m->_32 = v[TRANSFORM_OFFSET_Y];
+            break;
+
+        case TRANSFORM_SCALE:
+            m->_11 = v[TRANSFORM_SCALE_X];
+            m->_22 = v[TRANSFORM_SCALE_Y];
+            m->_31 = v[TRANSFORM_SCALE_CENTER_X] * (1.0f - m->_11);
+            m->_32 = v[TRANSFORM_SCALE_CENTER_Y] * (1.0f - m->_22);
+            break;
+
+        case TRANSFORM_ROTATE:
+            s = sinf(v[TRANSFORM_ANGLE] * DEGREES_TO_RADIANS);
+            c = cosf(v[TRANSFORM_ANGLE] * DEGREES_TO_RADIANS);
+            m->_11 = c;
+            m->_12 = s;
+            m->_21 = -s;
+            m->_22 = c;
+            m->_31 = v[TRANSFORM_ROTATE_CENTER_X] * (1.0f - c) + v[TRANSFORM_ROTATE_CENTER_Y] * s;
+            m->_32 = v[TRANSFORM_ROTATE_CENTER_Y] * (1.0f - c) - v[TRANSFORM_ROTATE_CENTER_X] * s;
+            break;
+
+        case TRANSFORM_SKEW:
+            m->_12 = tanf(v[TRANSFORM_ANGLE_Y] * DEGREES_TO_RADIANS);
+            m->_21 = tanf(v[TRANSFORM_ANGLE_X] * DEGREES_TO_RADIANS);
+            m->_31 = -v[TRANSFORM_SKEW_CENTER_Y] * m->_21;
+            m->_32 = -v[TRANSFORM_SKEW_CENTER_X] * m->_12;
+            break;
+
+        case TRANSFORM_MATRIX:
+            m->_11 = v[0];
+            m->_12 = v[1];
+            m->_21 = v[2];
+            m->_22 = v[3];
+            m->_31 = v[4];
+            m->_32 = v[5];
+            break;
+
+        case TRANSFORM_GROUP:
+            break;
+    }
+}
+
+/* The transform's matrix, evaluated if anything it depends on changed.
+ * Called with the device lock held. */
+const D2D_MATRIX_3X2_F *transform_evaluate(struct composition_transform *transform)
+{
+    D2D_MATRIX_3X2_F *m = &transform->matrix;
+    unsigned int i;
+
+    if (!transform->dirty)
+        return m;
+
+    transform_matrix(transform->type, transform->values, m);
+    /* The first transform of a group is applied first. */
+    for (i = 0; i < transform->child_count; i++)
+        multiply_matrix(m, m, transform_evaluate(transform->children[i]));
+
+    transform->dirty = FALSE;
+    return m;
+}
+
+static HRESULT STDMETHODCALLTYPE transform_QueryInterface(IDCompositionTransform *iface, REFIID iid, void **out)
+{
+    struct composition_transform *transform = impl_from_IDCompositionTransform(iface);
+    static const IID *type_iids[] =
+    {
+        &IID_IDCompositionTranslateTransform,
+        &IID_IDCompositionScaleTransform,
+        &IID_IDCompositionRotateTransform,
+        &IID_IDCompositionSkewTransform,
+        &IID_IDCompositionMatrixTransform,
+        &IID_IDCompositionTransform,
+    };
+
+    TRACE("iface %p, iid %s, out %p\n", iface, debugstr_guid(iid), out);
+
+    if (IsEqualGUID(iid, &IID_IUnknown)
+            || IsEqualGUID(iid, &IID_IDCompositionEffect)
+            || IsEqualGUID(iid, &IID_IDCompositionTransform3D)
+            || IsEqualGUID(iid, &IID_IDCompositionTransform)
+            || IsEqualGUID(iid, type_iids[transform->type]))
+    {
+        IUnknown_AddRef(iface);
+        *out = iface;
+        return S_OK;
+    }
+
+    FIXME("%s not implemented, returning E_NOINTERFACE.\n", debugstr_guid(iid));
+    *out = NULL;
+    return E_NOINTERFACE;
+}
+
+static ULONG STDMETHODCALLTYPE transform_AddRef(IDCompositionTransform *iface)
+{
+    struct composition_transform *transform = impl_from_IDCompositionTransform(iface);
+    ULONG ref = InterlockedIncrement(&transform->ref);
+
+    TRACE("iface %p, ref %lu.\n", iface, ref);
+    return ref;
+}
+
+static ULONG STDMETHODCALLTYPE transform_Release(IDCompositionTransform *iface)
+{
+    struct composition_transform *transform = impl_from_IDCompositionTransform(iface);
+    ULONG ref = InterlockedDecrement(&transform->ref);
+
+    TRACE("iface %p, ref %lu.\n", iface, ref);
+
+    if (!ref)
+    {
+        struct composition_device *device = transform->device;
+        unsigned int i;
+
+        /* Queued parameter changes point to the transform. Visuals and
+         * groups using it hold references, so nothing else does. */
+        EnterCriticalSection(&device->cs);
+        apply_visual_commands(device);
+        for (i = 0; i < TRANSFORM_VALUE_COUNT; i++)
+            transform_set_animation(transform, i, NULL);
+        for (i = 0; i < transform->child_count; i++)
+        {
+            list_remove(&transform->links[i].entry);
+            IDCompositionTransform_Release(&transform->children[i]->IDCompositionTransform_iface);
+        }
+        LeaveCriticalSection(&device->cs);
+        free(transform->children);
+        free(transform->links);
+        free(transform);
+        IDCompositionDevice_Release(&device->IDCompositionDevice_iface);
+    }
+
+    return ref;
+}
+
+/* The typed interfaces forward their IUnknown methods. */
+#define TRANSFORM_IUNKNOWN_METHODS(prefix, type) \
+    static HRESULT STDMETHODCALLTYPE prefix##_QueryInterface(type *iface, REFIID iid, void **out) \
+    { \
+        return transform_QueryInterface((IDCompositionTransform *)iface, iid, out); \
+    } \
+    static ULONG STDMETHODCALLTYPE prefix##_AddRef(type *iface) \
+    { \
+        return transform_AddRef((IDCompositionTransform *)iface); \
+    } \
+    static ULONG STDMETHODCALLTYPE prefix##_Release(type *iface) \
+    { \
+        return transform_Release((IDCompositionTransform *)iface); \
+    }
+
+TRANSFORM_IUNKNOWN_METHODS(translate_transform, IDCompositionTranslateTransform)
+TRANSFORM_IUNKNOWN_METHODS(scale_transform, IDCompositionScaleTransform)
+TRANSFORM_IUNKNOWN_METHODS(rotate_transform, IDCompositionRotateTransform)
+TRANSFORM_IUNKNOWN_METHODS(skew_transform, IDCompositionSkewTransform)
+TRANSFORM_IUNKNOWN_METHODS(matrix_transform, IDCompositionMatrixTransform)
+
+static HRESULT set_value(void *iface, unsigned int index, float value)
+{
+    return queue_transform_values(impl_from_transform_iface(iface), index, 1, &value);
+}
+
+static HRESULT set_animation(void *iface, unsigned int index, IDCompositionAnimation *animation)
+{
+    TRACE("iface %p, index %u, animation %p\n", iface, index, animation);
+    return queue_transform_animation(impl_from_transform_iface(iface), index, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE translate_transform_SetOffsetXAnimation(IDCompositionTranslateTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_OFFSET_X, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE translate_transform_SetOffsetX(IDCompositionTranslateTransform *iface,
+        float offset_x)
+{
+    TRACE("iface %p, offset_x %f\n", iface, offset_x);
+    return set_value(iface, TRANSFORM_OFFSET_X, offset_x);
+}
+
+static HRESULT STDMETHODCALLTYPE translate_transform_SetOffsetYAnimation(IDCompositionTranslateTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_OFFSET_Y, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE translate_transform_SetOffsetY(IDCompositionTranslateTransform *iface,
+        float offset_y)
+{
+    TRACE("iface %p, offset_y %f\n", iface, offset_y);
+    return set_value(iface, TRANSFORM_OFFSET_Y, offset_y);
+}
+
+static const struct IDCompositionTranslateTransformVtbl translate_transform_vtbl =
+{
+    /* IUnknown methods */
+    translate_transform_QueryInterface,
+    translate_transform_AddRef,
+    translate_transform_Release,
+    /* IDCompositionTranslateTransform methods */
+    translate_transform_SetOffsetXAnimation,
+    translate_transform_SetOffsetX,
+    translate_transform_SetOffsetYAnimation,
+    translate_transform_SetOffsetY,
+};
+
+static HRESULT STDMETHODCALLTYPE scale_transform_SetScaleXAnimation(IDCompositionScaleTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_SCALE_X, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE scale_transform_SetScaleX(IDCompositionScaleTransform *iface, float scale_x)
+{
+    TRACE("iface %p, scale_x %f\n", iface, scale_x);
+    return set_value(iface, TRANSFORM_SCALE_X, scale_x);
+}
+
+static HRESULT STDMETHODCALLTYPE scale_transform_SetScaleYAnimation(IDCompositionScaleTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_SCALE_Y, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE scale_transform_SetScaleY(IDCompositionScaleTransform *iface, float scale_y)
+{
+    TRACE("iface %p, scale_y %f\n", iface, scale_y);
+    return set_value(iface, TRANSFORM_SCALE_Y, scale_y);
+}
+
+static HRESULT STDMETHODCALLTYPE scale_transform_SetCenterXAnimation(IDCompositionScaleTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_SCALE_CENTER_X, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE scale_transform_SetCenterX(IDCompositionScaleTransform *iface, float center_x)
+{
+    TRACE("iface %p, center_x %f\n", iface, center_x);
+    return set_value(iface, TRANSFORM_SCALE_CENTER_X, center_x);
+}
+
+static HRESULT STDMETHODCALLTYPE scale_transform_SetCenterYAnimation(IDCompositionScaleTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_SCALE_CENTER_Y, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE scale_transform_SetCenterY(IDCompositionScaleTransform *iface, float center_y)
+{
+    TRACE("iface %p, center_y %f\n", iface, center_y);
+    return set_value(iface, TRANSFORM_SCALE_CENTER_Y, center_y);
+}
+
+static const struct IDCompositionScaleTransformVtbl scale_transform_vtbl =
+{
+    /* IUnknown methods */
+    scale_transform_QueryInterface,
+    scale_transform_AddRef,
+    scale_transform_Release,
+    /* IDCompositionScaleTransform methods */
+    scale_transform_SetScaleXAnimation,
+    scale_transform_SetScaleX,
+    scale_transform_SetScaleYAnimation,
+    scale_transform_SetScaleY,
+    scale_transform_SetCenterXAnimation,
+    scale_transform_SetCenterX,
+    scale_transform_SetCenterYAnimation,
+    scale_transform_SetCenterY,
+};
+
+static HRESULT STDMETHODCALLTYPE rotate_transform_SetAngleAnimation(IDCompositionRotateTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_ANGLE, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE rotate_transform_SetAngle(IDCompositionRotateTransform *iface, float angle)
+{
+    TRACE("iface %p, angle %f\n", iface, angle);
+    return set_value(iface, TRANSFORM_ANGLE, angle);
+}
+
+static HRESULT STDMETHODCALLTYPE rotate_transform_SetCenterXAnimation(IDCompositionRotateTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_ROTATE_CENTER_X, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE rotate_transform_SetCenterX(IDCompositionRotateTransform *iface, float center_x)
+{
+    TRACE("iface %p, center_x %f\n", iface, center_x);
+    return set_value(iface, TRANSFORM_ROTATE_CENTER_X, center_x);
+}
+
+static HRESULT STDMETHODCALLTYPE rotate_transform_SetCenterYAnimation(IDCompositionRotateTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_ROTATE_CENTER_Y, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE rotate_transform_SetCenterY(IDCompositionRotateTransform *iface, float center_y)
+{
+    TRACE("iface %p, center_y %f\n", iface, center_y);
+    return set_value(iface, TRANSFORM_ROTATE_CENTER_Y, center_y);
+}
+
+static const struct IDCompositionRotateTransformVtbl rotate_transform_vtbl =
+{
+    /* IUnknown methods */
+    rotate_transform_QueryInterface,
+    rotate_transform_AddRef,
+    rotate_transform_Release,
+    /* IDCompositionRotateTransform methods */
+    rotate_transform_SetAngleAnimation,
+    rotate_transform_SetAngle,
+    rotate_transform_SetCenterXAnimation,
+    rotate_transform_SetCenterX,
+    rotate_transform_SetCenterYAnimation,
+    rotate_transform_SetCenterY,
+};
+
+static HRESULT STDMETHODCALLTYPE skew_transform_SetAngleXAnimation(IDCompositionSkewTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_ANGLE_X, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE skew_transform_SetAngleX(IDCompositionSkewTransform *iface, float angle_x)
+{
+    TRACE("iface %p, angle_x %f\n", iface, angle_x);
+    return set_value(iface, TRANSFORM_ANGLE_X, angle_x);
+}
+
+static HRESULT STDMETHODCALLTYPE skew_transform_SetAngleYAnimation(IDCompositionSkewTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_ANGLE_Y, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE skew_transform_SetAngleY(IDCompositionSkewTransform *iface, float angle_y)
+{
+    TRACE("iface %p, angle_y %f\n", iface, angle_y);
+    return set_value(iface, TRANSFORM_ANGLE_Y, angle_y);
+}
+
+static HRESULT STDMETHODCALLTYPE skew_transform_SetCenterXAnimation(IDCompositionSkewTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_SKEW_CENTER_X, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE skew_transform_SetCenterX(IDCompositionSkewTransform *iface, float center_x)
+{
+    TRACE("iface %p, center_x %f\n", iface, center_x);
+    return set_value(iface, TRANSFORM_SKEW_CENTER_X, center_x);
+}
+
+static HRESULT STDMETHODCALLTYPE skew_transform_SetCenterYAnimation(IDCompositionSkewTransform *iface,
+        IDCompositionAnimation *animation)
+{
+    return set_animation(iface, TRANSFORM_SKEW_CENTER_Y, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE skew_transform_SetCenterY(IDCompositionSkewTransform *iface, float center_y)
+{
+    TRACE("iface %p, center_y %f\n", iface, center_y);
+    return set_value(iface, TRANSFORM_SKEW_CENTER_Y, center_y);
+}
+
+static const struct IDCompositionSkewTransformVtbl skew_transform_vtbl =
+{
+    /* IUnknown methods */
+    skew_transform_QueryInterface,
+    skew_transform_AddRef,
+    skew_transform_Release,
+    /* IDCompositionSkewTransform methods */
+    skew_transform_SetAngleXAnimation,
+    skew_transform_SetAngleX,
+    skew_transform_SetAngleYAnimation,
+    skew_transform_SetAngleY,
+    skew_transform_SetCenterXAnimation,
+    skew_transform_SetCenterX,
+    skew_transform_SetCenterYAnimation,
+    skew_transform_SetCenterY,
+};
+
+static HRESULT STDMETHODCALLTYPE matrix_transform_SetMatrix(IDCompositionMatrixTransform *iface,
+        const D2D_MATRIX_3X2_F *matrix)
+{
+    TRACE("iface %p, matrix %p\n", iface, matrix);
+
+    if (!matrix)
+        return E_INVALIDARG;
+    return queue_transform_values(impl_from_transform_iface(iface), 0, 6, &matrix->_11);
+}
+
+static HRESULT STDMETHODCALLTYPE matrix_transform_SetMatrixElementAnimation(IDCompositionMatrixTransform *iface,
+        int row, int column, IDCompositionAnimation *animation)
+{
+    if (row < 0 || row > 2 || column < 0 || column > 1)
+        return E_INVALIDARG;
+    return set_animation(iface, row * 2 + column, animation);
+}
+
+static HRESULT STDMETHODCALLTYPE matrix_transform_SetMatrixElement(IDCompositionMatrixTransform *iface,
+        int row, int column, float value)
+{
+    TRACE("iface %p, row %d, column %d, value %f\n", iface, row, column, value);
+
+    if (row < 0 || row > 2 || column < 0 || column > 1)
+        return E_INVALIDARG;
+    return set_value(iface, row * 2 + column, value);
+}
+
+static const struct IDCompositionMatrixTransformVtbl matrix_transform_vtbl =
+{
+    /* IUnknown methods */
+    matrix_transform_QueryInterface,
+    matrix_transform_AddRef,
+    matrix_transform_Release,
+    /* IDCompositionMatrixTransform methods */
+    matrix_transform_SetMatrix,
+    matrix_transform_SetMatrixElementAnimation,
+    matrix_transform_SetMatrixElement,
+};
+
+static const struct IDCompositionTransformVtbl transform_group_vtbl =
+{
+    /* IUnknown methods */
+    transform_QueryInterface,
+    transform_AddRef,
+    transform_Release,
+};
+
+static struct composition_transform *transform_alloc(struct composition_device *device, enum transform_type type)
+{
+    static const void *vtbls[] =
+    {
+        &translate_transform_vtbl,
+        &scale_transform_vtbl,
+        &rotate_transform_vtbl,
+        &skew_transform_vtbl,
+        &matrix_transform_vtbl,
+        &transform_group_vtbl,
+    };
+    struct composition_transform *transform;
+
+    if (!(transform = calloc(1, sizeof(*transform))))
+        return NULL;
+
+    transform->IDCompositionTransform_iface.lpVtbl = vtbls[type];
+    transform->device = device;
+    IDCompositionDevice_AddRef(&device->IDCompositionDevice_iface);
+    transform->type = type;
+    list_init(&transform->groups);
+    list_init(&transform->visuals);
+    transform->dirty = TRUE;
+    transform->ref = 1;
+
+    if (type == TRANSFORM_SCALE)
+        transform->values[TRANSFORM_SCALE_X] = transform->values[TRANSFORM_SCALE_Y] = 1.0f;
+    else if (type == TRANSFORM_MATRIX)
+        transform->values[0] = transform->values[3] = 1.0f;
+    return transform;
+}
+
+HRESULT create_transform(struct composition_device *device, enum transform_type type, void **out)
+{
+    struct composition_transform *transform;
+
+    if (!out)
+        return E_INVALIDARG;
+
+    if (!(transform = transform_alloc(device, type)))
+        return E_OUTOFMEMORY;
+
+    TRACE("created transform %p, type %u\n", transform, type);
+    *out = &transform->IDCompositionTransform_iface;
+    return S_OK;
+}
+
+HRESULT create_transform_group(struct composition_device *device, IDCompositionTransform **transforms,
+        UINT count, IDCompositionTransform **out)
+{
+    struct composition_transform *group, *child;
+    unsigned int i;
+
+    if (!out || !transforms || !count)
+        return E_INVALIDARG;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!(child = unsafe_impl_from_IDCompositionTransform(transforms[i])) || child->device != device)
+            return E_INVALIDARG;
+    }
+
+    if (!(group = transform_alloc(device, TRANSFORM_GROUP)))
+        return E_OUTOFMEMORY;
+    if (!(group->children = calloc(count, sizeof(*group->children)))
+            || !(group->links = calloc(count, sizeof(*group->links))))
+    {
+        IDCompositionTransform_Release(&group->IDCompositionTransform_iface);
+        return E_OUTOFMEMORY;
+    }
+
+    EnterCriticalSection(&device->cs);
+    for (i = 0; i < count; i++)
+    {
+        child = unsafe_impl_from_IDCompositionTransform(transforms[i]);
+        IDCompositionTransform_AddRef(&child->IDCompositionTransform_iface);
+        group->children[i] = child;
+        group->links[i].group = group;
+        list_add_tail(&child->groups, &group->links[i].entry);
+    }
+    group->child_count = count;
+    LeaveCriticalSection(&device->cs);
+
+    TRACE("created transform group %p of %u transform(s)\n", group, count);
+    *out = &group->IDCompositionTransform_iface;
+    return S_OK;
+}
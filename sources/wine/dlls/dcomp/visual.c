@@ -18,6 +18,8 @@
  */
 
 #include <stdarg.h>
+#include <malloc.h>
+#include <string.h>
 
 #define COBJMACROS
 #include "windef.h"
@@ -27,6 +29,323 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(dcomp);
 
+/* Record a change to a visual, called with the device lock held. The
+ * visual's tree is queued for the next Commit, and content_delta is added to
+ * the content count of the visual and its ancestors. reindex means the set
+ * or order of content visuals in the tree changed, so the target's content
+ * index must be rebuilt; other changes only refresh the indexed entries. */
+static void visual_mark_changed(struct composition_visual *visual, int content_delta, BOOL reindex)
+{
+    visual->content_count += content_delta;
+    while (visual->parent)
+    {
+        visual = visual->parent;
+        visual->content_count += content_delta;
+    }
+    if (visual->target)
+    {
+        if (reindex)
+            visual->target->index_dirty = TRUE;
+        target_mark_dirty(visual->target);
+    }
+}
+
+/* Property setters do not take the device lock. They push a command on the
+ * device's lock-free queue, so any number of threads can update visuals
+ * without contending with each other or with Commit; Commit applies the
+ * queued commands in order before it reads the staged tree. Transform
+ * objects queue their parameter changes here too.
+ *
+ * A command does not hold a reference to its visual or transform: their
+ * final Release applies the queue before freeing them, and no command can be
+ * queued for an object once its last reference is gone. */
+enum visual_command_type
+{
+    VISUAL_COMMAND_OFFSET_X,
+    VISUAL_COMMAND_OFFSET_Y,
+    VISUAL_COMMAND_TRANSFORM,
+    VISUAL_COMMAND_TRANSFORM_OBJECT,
+    VISUAL_COMMAND_CONTENT,
+    VISUAL_COMMAND_TRANSFORM_VALUES,
+    VISUAL_COMMAND_OFFSET_X_ANIMATION,
+    VISUAL_COMMAND_OFFSET_Y_ANIMATION,
+    VISUAL_COMMAND_TRANSFORM_ANIMATION,
+};
+
+struct visual_command
+{
+    SLIST_ENTRY entry;
+    struct composition_visual *visual;  /* NULL for transform commands */
+    enum visual_command_type type;
+    union
+    {
+        float offset;
+        D2D_MATRIX_3X2_F matrix;
+        IUnknown *content;  /* holds a reference */
+        struct composition_transform *transform; /* holds a reference */
+        struct animation_function *function; /* holds a reference */
+        struct
+        {
+            struct composition_transform *transform;
+            unsigned int first;
+            unsigned int count;
+            float values[TRANSFORM_VALUE_COUNT];
+        } values;
+        struct
+        {
+            struct composition_transform *transform;
+            unsigned int index;
+            struct animation_function *function; /* holds a reference */
+        } animation;
+    } u;
+    /* A transform object the command took off its visual. Its reference is
+     * dropped once every command is applied, since a final Release applies
+     * the queue again. */
+    struct composition_transform *detached;
+};
+
+#define MAX_FREE_VISUAL_COMMANDS 256
+
+static struct visual_command *visual_command_create(struct composition_device *device,
+        struct composition_visual *visual, enum visual_command_type type)
+{
+    struct visual_command *command;
+    SLIST_ENTRY *entry;
+
+    if ((entry = InterlockedPopEntrySList(&device->free_commands)))
+        command = CONTAINING_RECORD(entry, struct visual_command, entry);
+    else if (!(command = _aligned_malloc(sizeof(*command), MEMORY_ALLOCATION_ALIGNMENT)))
+        return NULL;
+
+    command->visual = visual;
+    command->type = type;
+    command->detached = NULL;
+    return command;
+}
+
+static void visual_command_queue(struct composition_device *device, struct visual_command *command)
+{
+    InterlockedPushEntrySList(&device->commands, &command->entry);
+}
+
+static void visual_command_recycle(struct composition_device *device, struct visual_command *command)
+{
+    if (QueryDepthSList(&device->free_commands) < MAX_FREE_VISUAL_COMMANDS)
+        InterlockedPushEntrySList(&device->free_commands, &command->entry);
+    else
+        _aligned_free(command);
+}
+
+/* Replace the visual's transform object, taking over the caller's reference
+ * to the new one. Returns the old one, whose reference the caller has to
+ * drop. Called with the device lock held. */
+static struct composition_transform *visual_set_transform_object(struct composition_visual *visual,
+        struct composition_transform *transform)
+{
+    struct composition_transform *old = visual->transform;
+
+    if (old)
+    {
+        list_remove(&visual->transform_entry);
+        if (visual->transform_pending)
+        {
+            list_remove(&visual->transform_pending_entry);
+            visual->transform_pending = FALSE;
+        }
+    }
+    if ((visual->transform = transform))
+        list_add_tail(&transform->visuals, &visual->transform_entry);
+    return old;
+}
+
+/* Replace the visual's animation of the offset along axis, 0 for x and 1
+ * for y, taking over the caller's reference to the new one, which may be
+ * NULL. An animation starts at its absolute begin time if it has one, and
+ * otherwise now, at the Commit applying it. Called with the device lock
+ * held. */
+static void visual_set_offset_animation(struct composition_visual *visual, unsigned int axis,
+        struct animation_function *function)
+{
+    BOOL was_animated = visual->offset_animations[0] || visual->offset_animations[1];
+    LARGE_INTEGER now;
+
+    animation_function_release(visual->offset_animations[axis]);
+    if ((visual->offset_animations[axis] = function))
+    {
+        QueryPerformanceCounter(&now);
+        visual->animation_begin[axis] = function->begin_time ? function->begin_time : now.QuadPart;
+        if (!was_animated)
+            list_add_tail(&visual->device->animated_visuals, &visual->animation_entry);
+    }
+    else if (was_animated && !visual->offset_animations[!axis])
+    {
+        list_remove(&visual->animation_entry);
+    }
+}
+
+/* Called with the device lock held. */
+static void visual_command_apply(struct visual_command *command)
+{
+    struct composition_visual *visual = command->visual;
+    struct visual_properties *props;
+    int delta = 0;
+
+    if (command->type == VISUAL_COMMAND_TRANSFORM_VALUES)
+    {
+        transform_set_values(command->u.values.transform, command->u.values.first,
+                command->u.values.count, command->u.values.values);
+        return;
+    }
+    if (command->type == VISUAL_COMMAND_TRANSFORM_ANIMATION)
+    {
+        /* Like offset animations, this leaves the compiled entries alone. */
+        transform_set_animation(command->u.animation.transform, command->u.animation.index,
+                command->u.animation.function);
+        return;
+    }
+
+    props = &visual->device->props;
+    switch (command->type)
+    {
+        case VISUAL_COMMAND_OFFSET_X:
+            /* A value replaces an animation. */
+            if (visual->offset_animations[0])
+                visual_set_offset_animation(visual, 0, NULL);
+            if (props->offset_x[visual->slot] == command->u.offset)
+                return;
+            props->offset_x[visual->slot] = command->u.offset;
+            visual_properties_invalidate(props, visual->slot);
+            break;
+
+        case VISUAL_COMMAND_OFFSET_Y:
+            if (visual->offset_animations[1])
+                visual_set_offset_animation(visual, 1, NULL);
+            if (props->offset_y[visual->slot] == command->u.offset)
+                return;
+            props->offset_y[visual->slot] = command->u.offset;
+            visual_properties_invalidate(props, visual->slot);
+            break;
+
+        case VISUAL_COMMAND_TRANSFORM:
+            command->detached = visual_set_transform_object(visual, NULL);
+            if (!visual_properties_set_transform(props, visual->slot, &command->u.matrix))
+                return;
+            break;
+
+        case VISUAL_COMMAND_TRANSFORM_OBJECT:
+            if (visual->transform == command->u.transform)
+            {
+                command->detached = command->u.transform;
+                return;
+            }
+            command->detached = visual_set_transform_object(visual, command->u.transform);
+            if (!visual_properties_set_transform(props, visual->slot, transform_evaluate(visual->transform)))
+                return;
+            break;
+
+        case VISUAL_COMMAND_CONTENT:
+            if (visual->content == command->u.content)
+            {
+                if (command->u.content)
+                    IUnknown_Release(command->u.content);
+                return;
+            }
+            delta = !!command->u.content - !!visual->content;
+            if (visual->content)
+                IUnknown_Release(visual->content);
+            visual->content = command->u.content;
+            break;
+
+        /* Frames are built from every active target at each Commit, which
+         * picks up the animation; the compiled entries stay as they are. */
+        case VISUAL_COMMAND_OFFSET_X_ANIMATION:
+            visual_set_offset_animation(visual, 0, command->u.function);
+            return;
+
+        case VISUAL_COMMAND_OFFSET_Y_ANIMATION:
+            visual_set_offset_animation(visual, 1, command->u.function);
+            return;
+
+        case VISUAL_COMMAND_TRANSFORM_VALUES:
+        case VISUAL_COMMAND_TRANSFORM_ANIMATION:
+            break;
+    }
+
+    visual_mark_changed(visual, delta, delta != 0);
+}
+
+/* Give visuals whose transform object changed its new matrix. Called with
+ * the device lock held. */
+static unsigned int update_transform_visuals(struct composition_device *device)
+{
+    struct composition_visual *visual, *next;
+    unsigned int count = 0;
+
+    LIST_FOR_EACH_ENTRY_SAFE(visual, next, &device->transform_visuals, struct composition_visual,
+            transform_pending_entry)
+    {
+        list_remove(&visual->transform_pending_entry);
+        visual->transform_pending = FALSE;
+        if (visual_properties_set_transform(&device->props, visual->slot, transform_evaluate(visual->transform)))
+            visual_mark_changed(visual, 0, FALSE);
+        count++;
+    }
+    return count;
+}
+
+/* Apply every queued command. Called with the device lock held, which makes
+ * the caller the queue's only consumer. */
+void apply_visual_commands(struct composition_device *device)
+{
+    SLIST_ENTRY *entry, *next, *head = NULL;
+    struct visual_command *command;
+    unsigned int count = 0, updated;
+
+    /* The queue is LIFO; reverse it so commands apply in the order queued. */
+    for (entry = InterlockedFlushSList(&device->commands); entry; entry = next)
+    {
+        next = entry->Next;
+        entry->Next = head;
+        head = entry;
+    }
+
+    for (entry = head; entry; entry = entry->Next)
+    {
+        visual_command_apply(CONTAINING_RECORD(entry, struct visual_command, entry));
+        count++;
+    }
+    updated = update_transform_visuals(device);
+
+    for (entry = head; entry; entry = next)
+    {
+        command = CONTAINING_RECORD(entry, struct visual_command, entry);
+        next = entry->Next;
+        if (command->detached)
+            IDCompositionTransform_Release(&command->detached->IDCompositionTransform_iface);
+        visual_command_recycle(device, command);
+    }
+
+    if (count || updated)
+        TRACE("applied %u visual command(s), %u transform update(s)\n", count, updated);
+}
+
+void free_visual_commands(struct composition_device *device)
+{
+    SLIST_ENTRY *entry;
+
+    while ((entry = InterlockedPopEntrySList(&device->free_commands)))
+        _aligned_free(CONTAINING_RECORD(entry, struct visual_command, entry));
+}
+
+/* Called with the device lock held. */
+static void visual_detach_child(struct composition_visual *child)
+{
+    list_remove(&child->entry);
+    child->parent = NULL;
+    child->device->props.order_dirty = TRUE;
+    IDCompositionVisual2_Release(&child->IDCompositionVisual2_iface);
+}
+
 static HRESULT STDMETHODCALLTYPE visual2_QueryInterface(IDCompositionVisual2 *iface, REFIID iid,
         void **out)
 {
@@ -66,65 +385,185 @@ static ULONG STDMETHODCALLTYPE visual2_Release(IDCompositionVisual2 *iface)
 
     if (!ref)
     {
-        struct visual_child *child, *next;
-
-        LIST_FOR_EACH_ENTRY_SAFE(child, next, &visual->children, struct visual_child, entry)
-        {
-            IDCompositionVisual2_Release(child->visual);
-            list_remove(&child->entry);
-            free(child);
-        }
+        struct composition_device *device = visual->device;
+        struct composition_visual *child, *next;
+        struct composition_transform *transform;
+
+        EnterCriticalSection(&device->cs);
+        apply_visual_commands(device);
+        LIST_FOR_EACH_ENTRY_SAFE(child, next, &visual->children, struct composition_visual, entry)
+            visual_detach_child(child);
+        if ((transform = visual_set_transform_object(visual, NULL)))
+            IDCompositionTransform_Release(&transform->IDCompositionTransform_iface);
+        visual_set_offset_animation(visual, 0, NULL);
+        visual_set_offset_animation(visual, 1, NULL);
+        visual_properties_remove(&device->props, visual);
+        LeaveCriticalSection(&device->cs);
         if (visual->content)
             IUnknown_Release(visual->content);
-        free(visual);
+        object_pool_free(&device->visual_pool, visual);
+        IDCompositionDevice_Release(&device->IDCompositionDevice_iface);
     }
 
     return ref;
 }
 
+/* Queue a snapshot of the animation, which the compositor then evaluates on
+ * its own, so the offset changes at every composition interval without any
+ * further Commit. */
+static HRESULT queue_offset_animation(struct composition_visual *visual, enum visual_command_type type,
+        IDCompositionAnimation *animation)
+{
+    struct composition_animation *object;
+    struct visual_command *command;
+
+    if (!(object = unsafe_impl_from_IDCompositionAnimation(animation)))
+        return E_INVALIDARG;
+
+    if (!(command = visual_command_create(visual->device, visual, type)))
+        return E_OUTOFMEMORY;
+    if (!(command->u.function = animation_snapshot(object)))
+    {
+        visual_command_recycle(visual->device, command);
+        return E_OUTOFMEMORY;
+    }
+    visual_command_queue(visual->device, command);
+    return S_OK;
+}
+
 static HRESULT STDMETHODCALLTYPE visual2_SetOffsetXAnimation(IDCompositionVisual2 *iface,
         IDCompositionAnimation *animation)
 {
+    struct composition_visual *visual = impl_from_IDCompositionVisual2(iface);
+
     TRACE("iface %p, animation %p\n", iface, animation);
-    return S_OK;
+    return queue_offset_animation(visual, VISUAL_COMMAND_OFFSET_X_ANIMATION, animation);
 }
 
 static HRESULT STDMETHODCALLTYPE visual2_SetOffsetX(IDCompositionVisual2 *iface, float offset_x)
 {
     struct composition_visual *visual = impl_from_IDCompositionVisual2(iface);
+    struct visual_command *command;
 
     TRACE("iface %p, offset_x %f\n", iface, offset_x);
-    visual->offset_x = offset_x;
+
+    if (!(command = visual_command_create(visual->device, visual, VISUAL_COMMAND_OFFSET_X)))
+        return E_OUTOFMEMORY;
+    command->u.offset = offset_x;
+    visual_command_queue(visual->device, command);
     return S_OK;
 }
 
 static HRESULT STDMETHODCALLTYPE visual2_SetOffsetYAnimation(IDCompositionVisual2 *iface,
         IDCompositionAnimation *animation)
 {
+    struct composition_visual *visual = impl_from_IDCompositionVisual2(iface);
+
     TRACE("iface %p, animation %p\n", iface, animation);
-    return S_OK;
+    return queue_offset_animation(visual, VISUAL_COMMAND_OFFSET_Y_ANIMATION, animation);
 }
 
 static HRESULT STDMETHODCALLTYPE visual2_SetOffsetY(IDCompositionVisual2 *iface, float offset_y)
 {
     struct composition_visual *visual = impl_from_IDCompositionVisual2(iface);
+    struct visual_command *command;
 
     TRACE("iface %p, offset_y %f\n", iface, offset_y);
-    visual->offset_y = offset_y;
+
+    if (!(command = visual_command_create(visual->device, visual, VISUAL_COMMAND_OFFSET_Y)))
+        return E_OUTOFMEMORY;
+    command->u.offset = offset_y;
+    visual_command_queue(visual->device, command);
+    return S_OK;
+}
+
+static HRESULT queue_transform(struct composition_visual *visual, const D2D_MATRIX_3X2_F *matrix)
+{
+    struct visual_command *command;
+
+    if (!(command = visual_command_create(visual->device, visual, VISUAL_COMMAND_TRANSFORM)))
+        return E_OUTOFMEMORY;
+    command->u.matrix = *matrix;
+    visual_command_queue(visual->device, command);
     return S_OK;
 }
 
 static HRESULT STDMETHODCALLTYPE visual2_SetTransform(IDCompositionVisual2 *iface,
         const D2D_MATRIX_3X2_F *matrix)
 {
+    struct composition_visual *visual = impl_from_IDCompositionVisual2(iface);
+
     TRACE("iface %p, matrix %p\n", iface, matrix);
-    return S_OK;
+
+    if (!matrix)
+        return E_INVALIDARG;
+
+    TRACE("matrix {%f, %f, %f, %f, %f, %f}\n", matrix->_11, matrix->_12, matrix->_21, matrix->_22,
+            matrix->_31, matrix->_32);
+    return queue_transform(visual, matrix);
 }
 
 static HRESULT STDMETHODCALLTYPE visual2_SetTransformObject(IDCompositionVisual2 *iface,
         IDCompositionTransform *transform)
 {
+    static const D2D_MATRIX_3X2_F identity = {{{1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f}}};
+    struct composition_visual *visual = impl_from_IDCompositionVisual2(iface);
+    struct composition_transform *object;
+    struct visual_command *command;
+
     TRACE("iface %p, transform %p\n", iface, transform);
+
+    /* Clearing the transform property leaves the visual untransformed. */
+    if (!transform)
+        return queue_transform(visual, &identity);
+
+    if (!(object = unsafe_impl_from_IDCompositionTransform(transform)) || object->device != visual->device)
+        return E_INVALIDARG;
+
+    if (!(command = visual_command_create(visual->device, visual, VISUAL_COMMAND_TRANSFORM_OBJECT)))
+        return E_OUTOFMEMORY;
+    IDCompositionTransform_AddRef(transform);
+    command->u.transform = object;
+    visual_command_queue(visual->device, command);
+    return S_OK;
+}
+
+HRESULT queue_transform_values(struct composition_transform *transform, unsigned int first, unsigned int count,
+        const float *values)
+{
+    struct visual_command *command;
+
+    if (!(command = visual_command_create(transform->device, NULL, VISUAL_COMMAND_TRANSFORM_VALUES)))
+        return E_OUTOFMEMORY;
+    command->u.values.transform = transform;
+    command->u.values.first = first;
+    command->u.values.count = count;
+    memcpy(command->u.values.values, values, count * sizeof(*values));
+    visual_command_queue(transform->device, command);
+    return S_OK;
+}
+
+/* Queue a snapshot of the animation for the index-th parameter of the
+ * transform, see queue_offset_animation(). */
+HRESULT queue_transform_animation(struct composition_transform *transform, unsigned int index,
+        IDCompositionAnimation *animation)
+{
+    struct composition_animation *object;
+    struct visual_command *command;
+
+    if (!(object = unsafe_impl_from_IDCompositionAnimation(animation)))
+        return E_INVALIDARG;
+
+    if (!(command = visual_command_create(transform->device, NULL, VISUAL_COMMAND_TRANSFORM_ANIMATION)))
+        return E_OUTOFMEMORY;
+    command->u.animation.transform = transform;
+    command->u.animation.index = index;
+    if (!(command->u.animation.function = animation_snapshot(object)))
+    {
+        visual_command_recycle(transform->device, command);
+        return E_OUTOFMEMORY;
+    }
+    visual_command_queue(transform->device, command);
     return S_OK;
 }
 
@@ -172,35 +611,77 @@ static HRESULT STDMETHODCALLTYPE visual2_SetClipObject(IDCompositionVisual2 *ifa
 static HRESULT STDMETHODCALLTYPE visual2_SetContent(IDCompositionVisual2 *iface, IUnknown *content)
 {
     struct composition_visual *visual = impl_from_IDCompositionVisual2(iface);
+    struct visual_command *command;
 
     TRACE("iface %p, content %p\n", iface, content);
 
-    if (visual->content)
-        IUnknown_Release(visual->content);
-
-    visual->content = content;
+    if (!(command = visual_command_create(visual->device, visual, VISUAL_COMMAND_CONTENT)))
+        return E_OUTOFMEMORY;
+    command->u.content = content;
     if (content)
         IUnknown_AddRef(content);
-
+    visual_command_queue(visual->device, command);
     return S_OK;
 }
 
+/* Children are kept in z-order, bottom-most first. */
 static HRESULT STDMETHODCALLTYPE visual2_AddVisual(IDCompositionVisual2 *iface,
         IDCompositionVisual *child_visual, BOOL insert_above, IDCompositionVisual *reference_visual)
 {
     struct composition_visual *visual = impl_from_IDCompositionVisual2(iface);
-    struct visual_child *child;
+    struct composition_visual *child, *reference = NULL, *ancestor;
 
     TRACE("iface %p, child %p, insert_above %d, reference %p\n", iface, child_visual,
             insert_above, reference_visual);
 
-    child = calloc(1, sizeof(*child));
-    if (!child)
-        return E_OUTOFMEMORY;
+    if (!child_visual)
+        return E_INVALIDARG;
+    child = impl_from_IDCompositionVisual2((IDCompositionVisual2 *)child_visual);
+    if (reference_visual)
+        reference = impl_from_IDCompositionVisual2((IDCompositionVisual2 *)reference_visual);
+    /* Visuals of another device are guarded by another lock. */
+    if (child->device != visual->device)
+        return E_INVALIDARG;
 
-    child->visual = (IDCompositionVisual2 *)child_visual;
-    IDCompositionVisual2_AddRef(child->visual);
-    list_add_tail(&visual->children, &child->entry);
+    EnterCriticalSection(&visual->device->cs);
+    /* A visual has a single parent, as it is linked through its own entry,
+     * and the root of a target has none. */
+    if (child->parent || child->target || (reference && reference->parent != visual))
+    {
+        LeaveCriticalSection(&visual->device->cs);
+        return E_INVALIDARG;
+    }
+    /* Nor may it be added below itself. */
+    for (ancestor = visual; ancestor; ancestor = ancestor->parent)
+    {
+        if (ancestor == child)
+        {
+            LeaveCriticalSection(&visual->device->cs);
+            return E_INVALIDARG;
+        }
+    }
+    IDCompositionVisual2_AddRef(&child->IDCompositionVisual2_iface);
+    if (reference)
+    {
+        if (insert_above)
+            list_add_after(&reference->entry, &child->entry);
+        else
+            list_add_before(&reference->entry, &child->entry);
+    }
+    /* Without a reference, insert_above puts the child below all of its
+     * siblings, and otherwise above them. */
+    else if (insert_above)
+    {
+        list_add_head(&visual->children, &child->entry);
+    }
+    else
+    {
+        list_add_tail(&visual->children, &child->entry);
+    }
+    child->parent = visual;
+    visual->device->props.order_dirty = TRUE;
+    visual_mark_changed(visual, child->content_count, child->content_count != 0);
+    LeaveCriticalSection(&visual->device->cs);
     return S_OK;
 }
 
@@ -208,36 +689,47 @@ static HRESULT STDMETHODCALLTYPE visual2_RemoveVisual(IDCompositionVisual2 *ifac
         IDCompositionVisual *child_visual)
 {
     struct composition_visual *visual = impl_from_IDCompositionVisual2(iface);
-    struct visual_child *child, *next;
+    struct composition_visual *child;
+    int delta;
 
     TRACE("iface %p, child %p\n", iface, child_visual);
 
-    LIST_FOR_EACH_ENTRY_SAFE(child, next, &visual->children, struct visual_child, entry)
+    if (!child_visual)
+        return E_INVALIDARG;
+    child = impl_from_IDCompositionVisual2((IDCompositionVisual2 *)child_visual);
+
+    EnterCriticalSection(&visual->device->cs);
+    if (child->parent != visual)
     {
-        if (child->visual == (IDCompositionVisual2 *)child_visual)
-        {
-            IDCompositionVisual2_Release(child->visual);
-            list_remove(&child->entry);
-            free(child);
-            return S_OK;
-        }
+        LeaveCriticalSection(&visual->device->cs);
+        return E_INVALIDARG;
     }
-    return E_INVALIDARG;
+    delta = -(int)child->content_count;
+    visual_detach_child(child);
+    visual_mark_changed(visual, delta, delta != 0);
+    LeaveCriticalSection(&visual->device->cs);
+    return S_OK;
 }
 
 static HRESULT STDMETHODCALLTYPE visual2_RemoveAllVisuals(IDCompositionVisual2 *iface)
 {
     struct composition_visual *visual = impl_from_IDCompositionVisual2(iface);
-    struct visual_child *child, *next;
+    struct composition_visual *child, *next;
+    int delta = 0;
 
     TRACE("iface %p\n", iface);
 
-    LIST_FOR_EACH_ENTRY_SAFE(child, next, &visual->children, struct visual_child, entry)
+    EnterCriticalSection(&visual->device->cs);
+    if (!list_empty(&visual->children))
     {
-        IDCompositionVisual2_Release(child->visual);
-        list_remove(&child->entry);
-        free(child);
+        LIST_FOR_EACH_ENTRY_SAFE(child, next, &visual->children, struct composition_visual, entry)
+        {
+            delta -= child->content_count;
+            visual_detach_child(child);
+        }
+        visual_mark_changed(visual, delta, delta != 0);
     }
+    LeaveCriticalSection(&visual->device->cs);
     return S_OK;
 }
 
@@ -291,7 +783,7 @@ static const struct IDCompositionVisual2Vtbl visual2_vtbl =
     visual2_SetBackFaceVisibility,
 };
 
-HRESULT create_visual(int version, REFIID iid, void **new_visual)
+HRESULT create_visual(struct composition_device *device, int version, REFIID iid, void **new_visual)
 {
     struct composition_visual *visual;
     HRESULT hr;
@@ -299,11 +791,22 @@ HRESULT create_visual(int version, REFIID iid, void **new_visual)
     if (!new_visual)
         return E_INVALIDARG;
 
-    visual = calloc(1, sizeof(*visual));
+    visual = object_pool_alloc(&device->visual_pool);
     if (!visual)
         return E_OUTOFMEMORY;
 
+    EnterCriticalSection(&device->cs);
+    if (!visual_properties_add(&device->props, visual))
+    {
+        LeaveCriticalSection(&device->cs);
+        object_pool_free(&device->visual_pool, visual);
+        return E_OUTOFMEMORY;
+    }
+    LeaveCriticalSection(&device->cs);
+
     visual->IDCompositionVisual2_iface.lpVtbl = &visual2_vtbl;
+    visual->device = device;
+    IDCompositionDevice_AddRef(&device->IDCompositionDevice_iface);
     visual->version = version;
     visual->ref = 1;
     list_init(&visual->children);
@@ -311,3 +814,27 @@ HRESULT create_visual(int version, REFIID iid, void **new_visual)
     IUnknown_Release(&visual->IDCompositionVisual2_iface);
     return hr;
 }
+
+/* Return the index-th child of a visual, counting from the bottom of the
+ * z-order, or NULL. dcomp has no way to enumerate the children of a visual,
+ * so this is exported for the tests. No reference is added. */
+IDCompositionVisual * CDECL __wine_dcomp_get_visual_child(IDCompositionVisual *iface, unsigned int index)
+{
+    struct composition_visual *visual, *child, *found = NULL;
+
+    if (!iface || (const void *)iface->lpVtbl != &visual2_vtbl)
+        return NULL;
+    visual = impl_from_IDCompositionVisual(iface);
+
+    EnterCriticalSection(&visual->device->cs);
+    LIST_FOR_EACH_ENTRY(child, &visual->children, struct composition_visual, entry)
+    {
+        if (!index--)
+        {
+            found = child;
+            break;
+        }
+    }
+    LeaveCriticalSection(&visual->device->cs);
+    return found ? (IDCompositionVisual *)&found->IDCompositionVisual2_iface : NULL;
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright 2026 Porthole contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#include <stdarg.h>
+#include <string.h>
+
+#define COBJMACROS
+#include "windef.h"
+#include "winbase.h"
+#include "wingdi.h"
+#include "winuser.h"
+#include "dcomp_private.h"
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(dcomp);
+
+/* Window operations are never issued from the compositor thread. user32
+ * implements SetParent and SetWindowPos on a window owned by another thread
+ * by sending messages to that thread and waiting for the reply, so the
+ * compositor would stall whenever the owner is busy, and deadlock if the
+ * owner is itself waiting on the compositor.
+ *
+ * Instead, each pass groups its operations by owning thread and posts every
+ * group as one batch to a window of that thread. The window is subclassed on
+ * first use; the subclass procedure runs the batch when the owner next pumps
+ * messages. Posting never waits, so commit latency does not depend on the
+ * owner being responsive. */
+
+static const WCHAR subclass_prop[] = L"__wine_dcomp_wndproc";
+static UINT apply_message;
+/* Every device's compositor subclasses windows, so installing and removing
+ * the subclass is serialised process-wide. */
+static SRWLOCK subclass_lock = SRWLOCK_INIT;
+
+struct placement_batch
+{
+    SIZE_T count;
+    struct window_placement placements[];
+};
+
+static int __cdecl compare_placement(const void *a, const void *b)
+{
+    const struct window_placement *pa = a, *pb = b;
+
+    if (pa->tid != pb->tid)
+        return pa->tid > pb->tid ? 1 : -1;
+    if (pa->parent > pb->parent)
+        return 1;
+    if (pa->parent < pb->parent)
+        return -1;
+    /* Keep queue order within a parent: it is the stacking order. */
+    if (pa->order != pb->order)
+        return pa->order > pb->order ? 1 : -1;
+    return 0;
+}
+
+/* Apply placements for windows owned by the calling thread, sorted by parent.
+ * DeferWindowPos requires all windows in one batch to share a parent, so
+ * there is one batch per parent; if a batch cannot be built, fall back to
+ * positioning windows one by one. */
+static void apply_placements(struct window_placement *placements, SIZE_T count)
+{
+    SIZE_T start, end, i;
+    HDWP hdwp;
+
+    for (i = 0; i < count; i++)
+    {
+        if (placements[i].blend_window)
+        {
+            blend_window_create(&placements[i]);
+            continue;
+        }
+        if (placements[i].retire)
+            SetWindowPos(placements[i].hwnd, NULL, 0, 0, 0, 0, SWP_HIDEWINDOW | SWP_NOMOVE | SWP_NOSIZE
+                    | SWP_NOZORDER | SWP_NOACTIVATE);
+        if (placements[i].reparent)
+        {
+            TRACE("reparenting hwnd %p into %p\n", placements[i].hwnd, placements[i].parent);
+            SetParent(placements[i].hwnd, placements[i].parent);
+        }
+        if (placements[i].style)
+            SetWindowLongW(placements[i].hwnd, GWL_STYLE, placements[i].style);
+    }
+
+    for (start = 0; start < count; start = end)
+    {
+        for (end = start + 1; end < count && placements[end].parent == placements[start].parent; end++)
+            ;
+
+        TRACE("placing %Iu window(s) in parent %p\n", end - start, placements[start].parent);
+
+        hdwp = BeginDeferWindowPos(end - start);
+        for (i = start; hdwp && i < end; i++)
+        {
+            if (placements[i].retire || placements[i].blend_window)
+                continue;
+            hdwp = DeferWindowPos(hdwp, placements[i].hwnd, HWND_TOP, placements[i].x, placements[i].y,
+                    placements[i].width, placements[i].height, placements[i].flags);
+        }
+
+        if (hdwp)
+        {
+            EndDeferWindowPos(hdwp);
+            continue;
+        }
+
+        WARN("DeferWindowPos batch failed, placing windows individually.\n");
+        for (i = start; i < end; i++)
+        {
+            if (!placements[i].retire && !placements[i].blend_window)
+                SetWindowPos(placements[i].hwnd, HWND_TOP, placements[i].x, placements[i].y,
+                        placements[i].width, placements[i].height, placements[i].flags);
+        }
+    }
+}
+
+static void run_placement_batch(struct placement_batch *batch)
+{
+    apply_placements(batch->placements, batch->count);
+    free(batch);
+}
+
+static LRESULT CALLBACK composition_window_proc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
+{
+    WNDPROC proc = GetPropW(hwnd, subclass_prop);
+    MSG pending;
+
+    if (msg == apply_message)
+    {
+        run_placement_batch((struct placement_batch *)lparam);
+        return 0;
+    }
+
+    if (msg == WM_NCDESTROY)
+    {
+        /* Batches may hold operations for other windows of this thread, so
+         * run whatever is still queued instead of leaking it. */
+        while (PeekMessageW(&pending, hwnd, apply_message, apply_message, PM_REMOVE))
+            run_placement_batch((struct placement_batch *)pending.lParam);
+        AcquireSRWLockExclusive(&subclass_lock);
+        SetWindowLongPtrW(hwnd, GWLP_WNDPROC, (LONG_PTR)proc);
+        RemovePropW(hwnd, subclass_prop);
+        ReleaseSRWLockExclusive(&subclass_lock);
+    }
+
+    return CallWindowProcW(proc, hwnd, msg, wparam, lparam);
+}
+
+/* Subclass a window so that it can receive placement batches. Changing the
+ * window procedure of a window in this process does not send any message to
+ * its owner, so this is safe from the compositor thread. */
+static BOOL subclass_window(HWND hwnd)
+{
+    BOOL ret = FALSE;
+    LONG_PTR proc;
+
+    AcquireSRWLockExclusive(&subclass_lock);
+
+    /* Taking our own procedure for the original one would make it call
+     * itself forever. */
+    proc = GetWindowLongPtrW(hwnd, GWLP_WNDPROC);
+    if (GetPropW(hwnd, subclass_prop) || proc == (LONG_PTR)composition_window_proc)
+    {
+        ret = TRUE;
+    }
+    /* Store the original procedure before installing ours, as the owner may
+     * dispatch a message to the new procedure immediately. */
+    else if (proc && SetPropW(hwnd, subclass_prop, (HANDLE)proc))
+    {
+        if ((ret = !!SetWindowLongPtrW(hwnd, GWLP_WNDPROC, (LONG_PTR)composition_window_proc)))
+            TRACE("subclassed hwnd %p for placement batches\n", hwnd);
+        else
+            RemovePropW(hwnd, subclass_prop);
+    }
+
+    ReleaseSRWLockExclusive(&subclass_lock);
+    return ret;
+}
+
+/* Post a batch of placements to the thread owning their windows. Returns
+ * FALSE if none of them will be applied. */
+static BOOL post_placements(const struct window_placement *placements, SIZE_T count)
+{
+    struct placement_batch *batch;
+    HWND carrier = placements[0].hwnd;
+
+    if (!(batch = malloc(offsetof(struct placement_batch, placements[count]))))
+    {
+        ERR("Failed to allocate a batch of %Iu placement(s).\n", count);
+        return FALSE;
+    }
+    batch->count = count;
+    memcpy(batch->placements, placements, count * sizeof(*placements));
+
+    if (!subclass_window(carrier) || !PostMessageW(carrier, apply_message, 0, (LPARAM)batch))
+    {
+        WARN("Failed to post placements to hwnd %p, error %lu.\n", carrier, GetLastError());
+        free(batch);
+        return FALSE;
+    }
+
+    TRACE("posted %Iu placement(s) to thread %#lx via hwnd %p\n", count, placements[0].tid, carrier);
+    return TRUE;
+}
+
+BOOL queue_window_placement(struct composition_device *device, const struct window_placement *placement)
+{
+    struct window_placement *entry;
+
+    if (!dcomp_array_reserve((void **)&device->placements, &device->placements_size,
+            device->placement_count + 1, sizeof(*device->placements)))
+    {
+        ERR("Failed to queue placement for hwnd %p.\n", placement->hwnd);
+        return FALSE;
+    }
+
+    entry = &device->placements[device->placement_count++];
+    *entry = *placement;
+    entry->order = device->placement_count - 1;
+    entry->tid = GetWindowThreadProcessId(placement->hwnd, NULL);
+    return TRUE;
+}
+
+/* Hand every placement gathered in this pass to the thread owning its
+ * window. Called on the compositor thread; returns without waiting. Planes
+ * whose placements could not be posted are placed again next pass. */
+void flush_window_placements(struct composition_device *device)
+{
+    struct window_placement *placements = device->placements;
+    SIZE_T count = device->placement_count, start, end, i;
+
+    if (!count)
+        return;
+
+    if (!apply_message)
+        apply_message = RegisterWindowMessageW(L"__wine_dcomp_apply_placements");
+
+    qsort(placements, count, sizeof(*placements), compare_placement);
+
+    for (start = 0; start < count; start = end)
+    {
+        for (end = start + 1; end < count && placements[end].tid == placements[start].tid; end++)
+            ;
+
+        if (!placements[start].tid)
+            continue;
+        if (placements[start].tid == GetCurrentThreadId())
+            apply_placements(&placements[start], end - start);
+        else if (!post_placements(&placements[start], end - start))
+        {
+            for (i = start; i < end; i++)
+                overlay_placement_lost(&placements[i]);
+        }
+    }
+
+    device->placement_count = 0;
+}
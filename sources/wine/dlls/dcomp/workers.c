@@ -0,0 +1,260 @@
+/*
+ * Copyright 2026 Porthole contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#include <stdarg.h>
+
+#define COBJMACROS
+#include "windef.h"
+#include "winbase.h"
+#include "dcomp_private.h"
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(dcomp);
+
+/* Worker pool for the compositor. A batch of tasks is split into one slice
+ * of consecutive task numbers per thread that may run it. Each thread claims
+ * tasks from its own slice first and steals from the other slices once its
+ * own runs dry; a claim is a single interlocked increment, so threads only
+ * contend on a slice when stealing from it.
+ *
+ * Several batches may be in flight at once, submitted from outside the pool
+ * or from a task. worker_pool_run() works on its batch too and returns once
+ * every task has finished; worker_pool_submit() returns at once and has the
+ * last thread to leave the batch call its completion callback. */
+
+struct worker_context
+{
+    struct worker_pool *pool;
+    unsigned int index;     /* slice this worker claims from first */
+};
+
+static BOOL worker_batch_claim(struct worker_batch *batch, unsigned int hint, unsigned int *task)
+{
+    struct worker_slice *slice;
+    unsigned int i;
+    LONG next;
+
+    for (i = 0; i < batch->slice_count; i++)
+    {
+        slice = &batch->slices[(hint + i) % batch->slice_count];
+        if (ReadNoFence(&slice->next) >= slice->end)
+            continue;
+        if ((next = InterlockedIncrement(&slice->next) - 1) < slice->end)
+        {
+            *task = next;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Run tasks of a batch until none is left to claim. The batch must have been
+ * pinned by the caller. Called without the pool lock. */
+static void worker_batch_work(struct worker_pool *pool, struct worker_batch *batch, unsigned int hint)
+{
+    unsigned int task, done = 0;
+    BOOL complete;
+
+    while (worker_batch_claim(batch, hint, &task))
+    {
+        batch->func(batch->context, task);
+        done++;
+    }
+
+    AcquireSRWLockExclusive(&pool->lock);
+    /* Nothing is left to claim; stop advertising the batch. */
+    if (batch->queued)
+    {
+        list_remove(&batch->entry);
+        batch->queued = FALSE;
+    }
+    batch->remaining -= done;
+    complete = !--batch->users && !batch->remaining && batch->complete;
+    if (!batch->users)
+        WakeAllConditionVariable(&pool->done_cv);
+    ReleaseSRWLockExclusive(&pool->lock);
+
+    /* The batch belongs to its owner again, which may resubmit it. */
+    if (complete)
+        batch->complete(batch);
+}
+
+static DWORD WINAPI worker_thread_proc(void *param)
+{
+    struct worker_context *context = param;
+    struct worker_pool *pool = context->pool;
+    unsigned int index = context->index;
+    struct worker_batch *batch;
+    struct list *entry;
+
+    free(context);
+    SetThreadDescription(GetCurrentThread(), L"wine_dcomp_worker");
+
+    AcquireSRWLockExclusive(&pool->lock);
+    /* Batches queued before the pool was stopped still run. */
+    while (!pool->stop || !list_empty(&pool->batches))
+    {
+        if (!(entry = list_head(&pool->batches)))
+        {
+            SleepConditionVariableSRW(&pool->work_cv, &pool->lock, INFINITE, 0);
+            continue;
+        }
+
+        batch = LIST_ENTRY(entry, struct worker_batch, entry);
+        batch->users++;
+        ReleaseSRWLockExclusive(&pool->lock);
+        worker_batch_work(pool, batch, index);
+        AcquireSRWLockExclusive(&pool->lock);
+    }
+    ReleaseSRWLockExclusive(&pool->lock);
+    return 0;
+}
+
+/* Start one worker per additional processor, up to WORKER_MAX_THREADS. If no
+ * worker can be started, batches simply run on the submitting thread. */
+void worker_pool_init(struct worker_pool *pool)
+{
+    struct worker_context *context;
+    SYSTEM_INFO info;
+    unsigned int i, count;
+
+    InitializeSRWLock(&pool->lock);
+    InitializeConditionVariable(&pool->work_cv);
+    InitializeConditionVariable(&pool->done_cv);
+    list_init(&pool->batches);
+    pool->stop = FALSE;
+    pool->thread_count = 0;
+
+    GetSystemInfo(&info);
+    count = min(max(info.dwNumberOfProcessors, 1) - 1, WORKER_MAX_THREADS);
+
+    for (i = 0; i < count; i++)
+    {
+        if (!(context = malloc(sizeof(*context))))
+            break;
+        context->pool = pool;
+        /* Slice 0 belongs to the submitter. */
+        context->index = i + 1;
+        if (!(pool->threads[i] = CreateThread(NULL, 0, worker_thread_proc, context, 0, NULL)))
+        {
+            WARN("Failed to start worker thread, error %lu.\n", GetLastError());
+            free(context);
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    TRACE("pool %p started %u worker(s)\n", pool, pool->thread_count);
+}
+
+void worker_pool_cleanup(struct worker_pool *pool)
+{
+    unsigned int i;
+
+    AcquireSRWLockExclusive(&pool->lock);
+    pool->stop = TRUE;
+    ReleaseSRWLockExclusive(&pool->lock);
+    WakeAllConditionVariable(&pool->work_cv);
+
+    for (i = 0; i < pool->thread_count; i++)
+    {
+        WaitForSingleObject(pool->threads[i], INFINITE);
+        CloseHandle(pool->threads[i]);
+    }
+    pool->thread_count = 0;
+}
+
+static void worker_batch_init(struct worker_batch *batch, unsigned int slice_count, worker_task_func func,
+        void *context, unsigned int count)
+{
+    unsigned int i, chunk;
+
+    batch->func = func;
+    batch->context = context;
+    batch->complete = NULL;
+    batch->slice_count = min(slice_count, count);
+    chunk = count / batch->slice_count;
+    for (i = 0; i < batch->slice_count; i++)
+    {
+        batch->slices[i].next = i * chunk + min(i, count % batch->slice_count);
+        batch->slices[i].end = batch->slices[i].next + chunk + (i < count % batch->slice_count);
+    }
+    batch->remaining = count;
+    batch->users = 0;
+}
+
+static void worker_pool_queue(struct worker_pool *pool, struct worker_batch *batch)
+{
+    AcquireSRWLockExclusive(&pool->lock);
+    list_add_tail(&pool->batches, &batch->entry);
+    batch->queued = TRUE;
+    ReleaseSRWLockExclusive(&pool->lock);
+    WakeAllConditionVariable(&pool->work_cv);
+}
+
+/* Queue func(context, task) for every task in [0, count) and return without
+ * waiting. complete(batch) is called on the thread that finishes last; until
+ * then the batch must stay alive and untouched. */
+void worker_pool_submit(struct worker_pool *pool, struct worker_batch *batch, worker_task_func func,
+        void *context, unsigned int count, void (*complete)(struct worker_batch *batch))
+{
+    unsigned int i;
+
+    if (!pool->thread_count || !count)
+    {
+        for (i = 0; i < count; i++)
+            func(context, i);
+        complete(batch);
+        return;
+    }
+
+    /* The submitter does not work on the batch; one slice per worker. */
+    worker_batch_init(batch, pool->thread_count, func, context, count);
+    batch->complete = complete;
+    worker_pool_queue(pool, batch);
+}
+
+/* Run func(context, task) for every task in [0, count) and return once all of
+ * them have finished. Tasks run concurrently, in no particular order. */
+void worker_pool_run(struct worker_pool *pool, worker_task_func func, void *context, unsigned int count)
+{
+    struct worker_batch batch;
+    unsigned int i;
+
+    if (!count)
+        return;
+
+    if (!pool->thread_count || count == 1)
+    {
+        for (i = 0; i < count; i++)
+            func(context, i);
+        return;
+    }
+
+    worker_batch_init(&batch, pool->thread_count + 1, func, context, count);
+    batch.users = 1;
+    worker_pool_queue(pool, &batch);
+
+    worker_batch_work(pool, &batch, 0);
+
+    /* Workers may still be finishing tasks they claimed, and must be done
+     * with the batch before it goes out of scope. */
+    AcquireSRWLockExclusive(&pool->lock);
+    while (batch.users || batch.remaining)
+        SleepConditionVariableSRW(&pool->done_cv, &pool->lock, INFINITE, 0);
+    ReleaseSRWLockExclusive(&pool->lock);
+}
@@ -276,6 +276,35 @@ int main(void)
     hr = dcomp_target->lpVtbl->SetRoot(dcomp_target, dcomp_visual);
     CHECK_HR("Target::SetRoot", hr);
 
+    {
+        IDCompositionVisual2 *parent = NULL, *child = NULL;
+
+        hr = desktop_device->lpVtbl->CreateVisual(desktop_device, &parent);
+        CHECK_HR("CreateVisual (parent)", hr);
+        if (SUCCEEDED(hr))
+        {
+            /* The root of a target cannot also be the child of a visual. */
+            hr = parent->lpVtbl->AddVisual(parent, dcomp_visual, FALSE, NULL);
+            CHECK_BOOL("AddVisual of a target root fails", hr == E_INVALIDARG);
+
+            hr = desktop_device->lpVtbl->CreateVisual(desktop_device, &child);
+            CHECK_HR("CreateVisual (child)", hr);
+            if (SUCCEEDED(hr))
+            {
+                hr = parent->lpVtbl->AddVisual(parent, child, FALSE, NULL);
+                CHECK_HR("AddVisual (child)", hr);
+
+                /* Nor can a visual that already has a parent become a root. */
+                hr = dcomp_target->lpVtbl->SetRoot(dcomp_target, child);
+                CHECK_BOOL("SetRoot of a parented visual fails", hr == E_INVALIDARG);
+
+                parent->lpVtbl->RemoveAllVisuals(parent);
+                child->lpVtbl->Release(child);
+            }
+            parent->lpVtbl->Release(parent);
+        }
+    }
+
     /* --- Stage 4: Swap chain + rendering --- */
     printf("\n--- Stage 4: Swap Chain + Rendering ---\n");
 
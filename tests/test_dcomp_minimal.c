@@ -1,6 +1,7 @@
 /*
  * Minimal test for DComp COM objects — works over SSH (no display needed).
- * Tests: device creation, visual creation, visual methods, QI, refcounting.
+ * Tests: device creation, visual creation, visual methods, QI, refcounting,
+ *        transform objects, animations.
  * Does NOT test: target creation (needs HWND), swap chain, compositing.
  *
  * Compile: x86_64-w64-mingw32-gcc -o test_dcomp_minimal.exe test_dcomp_minimal.c \
@@ -96,6 +97,55 @@ struct IDCompositionDesktopDeviceVtbl {
     HRESULT (STDMETHODCALLTYPE *CreateSurfaceFromHwnd)(IDCompositionDesktopDevice *, HWND, void **);
 };
 
+/* IDCompositionTranslateTransform vtable — matches Wine IDL order */
+typedef struct IDCompositionTranslateTransform IDCompositionTranslateTransform;
+
+struct IDCompositionTranslateTransformVtbl {
+    /* IUnknown */
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(IDCompositionTranslateTransform *, REFIID, void **);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(IDCompositionTranslateTransform *);
+    ULONG   (STDMETHODCALLTYPE *Release)(IDCompositionTranslateTransform *);
+    /* IDCompositionTranslateTransform */
+    HRESULT (STDMETHODCALLTYPE *SetOffsetXAnimation)(IDCompositionTranslateTransform *, void *);
+    HRESULT (STDMETHODCALLTYPE *SetOffsetX)(IDCompositionTranslateTransform *, float);
+    HRESULT (STDMETHODCALLTYPE *SetOffsetYAnimation)(IDCompositionTranslateTransform *, void *);
+    HRESULT (STDMETHODCALLTYPE *SetOffsetY)(IDCompositionTranslateTransform *, float);
+};
+
+struct IDCompositionTranslateTransform {
+    const struct IDCompositionTranslateTransformVtbl *lpVtbl;
+};
+
+/* IDCompositionAnimation vtable — matches Wine IDL order */
+typedef struct IDCompositionAnimation IDCompositionAnimation;
+
+struct IDCompositionAnimationVtbl {
+    /* IUnknown */
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(IDCompositionAnimation *, REFIID, void **);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(IDCompositionAnimation *);
+    ULONG   (STDMETHODCALLTYPE *Release)(IDCompositionAnimation *);
+    /* IDCompositionAnimation */
+    HRESULT (STDMETHODCALLTYPE *Reset)(IDCompositionAnimation *);
+    HRESULT (STDMETHODCALLTYPE *SetAbsoluteBeginTime)(IDCompositionAnimation *, LARGE_INTEGER);
+    HRESULT (STDMETHODCALLTYPE *AddCubic)(IDCompositionAnimation *, double, float, float, float, float);
+    HRESULT (STDMETHODCALLTYPE *AddSinusoidal)(IDCompositionAnimation *, double, float, float, float, float);
+    HRESULT (STDMETHODCALLTYPE *AddRepeat)(IDCompositionAnimation *, double, double);
+    HRESULT (STDMETHODCALLTYPE *End)(IDCompositionAnimation *, double, float);
+};
+
+struct IDCompositionAnimation {
+    const struct IDCompositionAnimationVtbl *lpVtbl;
+};
+
+/* DCOMPOSITION_FRAME_STATISTICS — matches dcomptypes.idl */
+typedef struct {
+    LARGE_INTEGER lastFrameTime;
+    struct { UINT Numerator, Denominator; } currentCompositionRate;
+    LARGE_INTEGER currentTime;
+    LARGE_INTEGER timeFrequency;
+    LARGE_INTEGER nextEstimatedFrameTime;
+} DCOMPOSITION_FRAME_STATISTICS;
+
 typedef HRESULT (WINAPI *PFN_DCompositionCreateDevice3)(IUnknown *, REFIID, void **);
 
 /* Test infrastructure */
@@ -209,6 +259,20 @@ int main(void)
     hr = visual1->lpVtbl->SetCompositeMode(visual1, 0);
     CHECK_HR("Visual::SetCompositeMode", hr);
 
+    /* CEF scales layers for zoom and DPI through the visual transform. */
+    {
+        static const float scale[6] = {2.0f, 0.0f, 0.0f, 2.0f, 5.0f, 5.0f};
+
+        hr = visual1->lpVtbl->SetTransform(visual1, scale);
+        CHECK_HR("Visual::SetTransform", hr);
+
+        hr = visual1->lpVtbl->SetTransform(visual1, NULL);
+        CHECK_BOOL("Visual::SetTransform(NULL) fails", hr == E_INVALIDARG);
+
+        hr = visual1->lpVtbl->SetTransformObject(visual1, NULL);
+        CHECK_HR("Visual::SetTransformObject(NULL)", hr);
+    }
+
     /* --- Stage 4: Visual tree operations --- */
     printf("\n--- Stage 4: Visual Tree ---\n");
 
@@ -218,19 +282,78 @@ int main(void)
     hr = visual1->lpVtbl->AddVisual(visual1, visual3, TRUE, NULL);
     CHECK_HR("AddVisual (visual3 to visual1)", hr);
 
+    hr = visual2->lpVtbl->AddVisual(visual2, visual3, TRUE, NULL);
+    CHECK_BOOL("AddVisual of a visual that already has a parent fails", hr == E_INVALIDARG);
+
     hr = visual1->lpVtbl->RemoveVisual(visual1, visual2);
     CHECK_HR("RemoveVisual (visual2 from visual1)", hr);
 
+    hr = visual1->lpVtbl->RemoveVisual(visual1, visual2);
+    CHECK_BOOL("RemoveVisual of a non-child fails", hr == E_INVALIDARG);
+
+    hr = visual1->lpVtbl->AddVisual(visual1, visual2, FALSE, visual3);
+    CHECK_HR("AddVisual (visual2 below visual3)", hr);
+
+    hr = visual2->lpVtbl->AddVisual(visual2, visual1, TRUE, visual3);
+    CHECK_BOOL("AddVisual relative to a non-child fails", hr == E_INVALIDARG);
+
+    hr = visual3->lpVtbl->AddVisual(visual3, visual1, TRUE, NULL);
+    CHECK_BOOL("AddVisual of an ancestor fails", hr == E_INVALIDARG);
+
     hr = visual1->lpVtbl->RemoveAllVisuals(visual1);
     CHECK_HR("RemoveAllVisuals", hr);
 
+    /* Without a reference, insert_above puts the child at the bottom of the
+     * z-order and !insert_above at the top; with one, the child goes right
+     * above or below the reference. */
+    {
+        IDCompositionVisual2 *(CDECL *pget_visual_child)(IDCompositionVisual2 *, unsigned int);
+        IDCompositionVisual2 *children[4] = {NULL}, *expect[4];
+        BOOL in_order;
+        int i;
+
+        pget_visual_child = (void *)GetProcAddress(dcomp_dll, "__wine_dcomp_get_visual_child");
+        CHECK_BOOL("GetProcAddress __wine_dcomp_get_visual_child", pget_visual_child != NULL);
+
+        for (i = 0, hr = S_OK; i < 4 && SUCCEEDED(hr); i++)
+            hr = device->lpVtbl->CreateVisual(device, &children[i]);
+        CHECK_HR("CreateVisual (z-order children)", hr);
+
+        if (SUCCEEDED(hr) && pget_visual_child)
+        {
+            hr = visual1->lpVtbl->AddVisual(visual1, children[0], FALSE, NULL);
+            if (SUCCEEDED(hr))
+                hr = visual1->lpVtbl->AddVisual(visual1, children[1], TRUE, NULL);
+            if (SUCCEEDED(hr))
+                hr = visual1->lpVtbl->AddVisual(visual1, children[2], TRUE, children[0]);
+            if (SUCCEEDED(hr))
+                hr = visual1->lpVtbl->AddVisual(visual1, children[3], FALSE, children[0]);
+            CHECK_HR("AddVisual in each z-order position", hr);
+
+            /* Bottom to top. */
+            expect[0] = children[1];
+            expect[1] = children[3];
+            expect[2] = children[0];
+            expect[3] = children[2];
+            for (i = 0, in_order = TRUE; i < 4; i++)
+                in_order = in_order && pget_visual_child(visual1, i) == expect[i];
+            CHECK_BOOL("AddVisual stacks children in z-order", in_order && !pget_visual_child(visual1, 4));
+
+            hr = visual1->lpVtbl->RemoveAllVisuals(visual1);
+            CHECK_HR("RemoveAllVisuals (z-order children)", hr);
+        }
+
+        for (i = 0; i < 4; i++)
+            if (children[i]) children[i]->lpVtbl->Release(children[i]);
+    }
+
     /* --- Stage 5: SetContent with NULL (valid) --- */
     printf("\n--- Stage 5: SetContent ---\n");
 
     hr = visual1->lpVtbl->SetContent(visual1, NULL);
     CHECK_HR("Visual::SetContent(NULL)", hr);
 
-    /* --- Stage 6: Commit (no-op in Phase 1) --- */
+    /* --- Stage 6: Commit --- */
     printf("\n--- Stage 6: Commit ---\n");
 
     hr = device->lpVtbl->Commit(device);
@@ -239,6 +362,62 @@ int main(void)
     hr = device->lpVtbl->WaitForCommitCompletion(device);
     CHECK_HR("Device::WaitForCommitCompletion", hr);
 
+    /* Frame-paced clients commit and wait every frame; each wait must
+     * return once the compositor has retired the commit. */
+    {
+        int i;
+        DWORD start = GetTickCount();
+
+        for (i = 0, hr = S_OK; i < 100 && SUCCEEDED(hr); i++)
+        {
+            hr = device->lpVtbl->Commit(device);
+            if (SUCCEEDED(hr))
+                hr = device->lpVtbl->WaitForCommitCompletion(device);
+        }
+        CHECK_HR("100x Commit + WaitForCommitCompletion", hr);
+        CHECK_BOOL("Commit/Wait loop completes within 5s", GetTickCount() - start < 5000);
+    }
+
+    /* A pass just ran, so commits issued back to back land in the same
+     * composition interval and are merged into the next pass. */
+    {
+        HRESULT (CDECL *pget_coalesced_commits)(IUnknown *, UINT64 *);
+        UINT64 before = 0, after = 0;
+        int i;
+
+        pget_coalesced_commits = (void *)GetProcAddress(dcomp_dll, "__wine_dcomp_get_coalesced_commits");
+        CHECK_BOOL("GetProcAddress __wine_dcomp_get_coalesced_commits", pget_coalesced_commits != NULL);
+        if (pget_coalesced_commits)
+        {
+            hr = pget_coalesced_commits((IUnknown *)device, &before);
+            CHECK_HR("__wine_dcomp_get_coalesced_commits", hr);
+
+            for (i = 0, hr = S_OK; i < 4 && SUCCEEDED(hr); i++)
+                hr = device->lpVtbl->Commit(device);
+            CHECK_HR("4x Commit", hr);
+            hr = device->lpVtbl->WaitForCommitCompletion(device);
+            CHECK_HR("Device::WaitForCommitCompletion", hr);
+
+            hr = pget_coalesced_commits((IUnknown *)device, &after);
+            CHECK_HR("__wine_dcomp_get_coalesced_commits", hr);
+            CHECK_BOOL("Back-to-back commits are merged", after - before >= 1 && after - before <= 3);
+        }
+    }
+
+    /* Chromium schedules frames from these; zeros put it on fallback timing. */
+    {
+        DCOMPOSITION_FRAME_STATISTICS stats = {0};
+
+        hr = device->lpVtbl->GetFrameStatistics(device, &stats);
+        CHECK_HR("Device::GetFrameStatistics", hr);
+        CHECK_BOOL("timeFrequency is non-zero", stats.timeFrequency.QuadPart > 0);
+        CHECK_BOOL("currentCompositionRate is non-zero",
+                stats.currentCompositionRate.Numerator && stats.currentCompositionRate.Denominator);
+        CHECK_BOOL("lastFrameTime <= currentTime < nextEstimatedFrameTime",
+                stats.lastFrameTime.QuadPart <= stats.currentTime.QuadPart
+                && stats.currentTime.QuadPart < stats.nextEstimatedFrameTime.QuadPart);
+    }
+
     /* --- Stage 7: Visual QI --- */
     printf("\n--- Stage 7: Visual QI ---\n");
 
@@ -260,6 +439,126 @@ int main(void)
     if (SUCCEEDED(hr))
         vis_v2->lpVtbl->Release(vis_v2);
 
+    /* --- Stage 8: Transform objects --- */
+    printf("\n--- Stage 8: Transform Objects ---\n");
+
+    {
+        IDCompositionTranslateTransform *translate = NULL;
+        IUnknown *scale = NULL, *group = NULL;
+        void *elements[2];
+
+        hr = device->lpVtbl->CreateTranslateTransform(device, (void **)&translate);
+        CHECK_HR("CreateTranslateTransform", hr);
+        hr = device->lpVtbl->CreateScaleTransform(device, (void **)&scale);
+        CHECK_HR("CreateScaleTransform", hr);
+
+        if (translate && scale)
+        {
+            elements[0] = translate;
+            elements[1] = scale;
+            hr = device->lpVtbl->CreateTransformGroup(device, elements, 2, (void **)&group);
+            CHECK_HR("CreateTransformGroup", hr);
+
+            hr = device->lpVtbl->CreateTransformGroup(device, elements, 0, (void **)&group);
+            CHECK_BOOL("CreateTransformGroup of no transforms fails", hr == E_INVALIDARG);
+        }
+
+        if (group)
+        {
+            hr = visual1->lpVtbl->SetTransformObject(visual1, group);
+            CHECK_HR("Visual::SetTransformObject(group)", hr);
+            hr = visual2->lpVtbl->SetTransformObject(visual2, group);
+            CHECK_HR("Visual::SetTransformObject(shared group)", hr);
+
+            /* Dependent visuals pick up the change without being touched. */
+            hr = translate->lpVtbl->SetOffsetX(translate, 12.0f);
+            CHECK_HR("TranslateTransform::SetOffsetX", hr);
+            hr = device->lpVtbl->Commit(device);
+            if (SUCCEEDED(hr))
+                hr = device->lpVtbl->WaitForCommitCompletion(device);
+            CHECK_HR("Commit after a shared transform changed", hr);
+
+            hr = visual1->lpVtbl->SetTransformObject(visual1, NULL);
+            CHECK_HR("Visual::SetTransformObject(NULL) detaches", hr);
+            group->lpVtbl->Release(group);
+        }
+
+        if (scale) scale->lpVtbl->Release(scale);
+        if (translate) translate->lpVtbl->Release(translate);
+    }
+
+    /* --- Stage 9: Animations --- */
+    printf("\n--- Stage 9: Animations ---\n");
+
+    {
+        IDCompositionAnimation *animation = NULL;
+
+        hr = device->lpVtbl->CreateAnimation(device, (void **)&animation);
+        CHECK_HR("CreateAnimation", hr);
+
+        if (animation)
+        {
+            /* Scroll 100 pixels in half a second, then hold. */
+            hr = animation->lpVtbl->AddCubic(animation, 0.0, 0.0f, 200.0f, 0.0f, 0.0f);
+            CHECK_HR("Animation::AddCubic", hr);
+            hr = animation->lpVtbl->AddCubic(animation, 0.0, 0.0f, 0.0f, 0.0f, 0.0f);
+            CHECK_BOOL("AddCubic out of order fails", hr == E_INVALIDARG);
+            hr = animation->lpVtbl->End(animation, 0.5, 100.0f);
+            CHECK_HR("Animation::End", hr);
+            hr = animation->lpVtbl->AddCubic(animation, 1.0, 0.0f, 0.0f, 0.0f, 0.0f);
+            CHECK_BOOL("AddCubic after End fails", FAILED(hr));
+
+            hr = visual2->lpVtbl->SetOffsetYAnimation(visual2, animation);
+            CHECK_HR("Visual::SetOffsetYAnimation", hr);
+            hr = visual2->lpVtbl->SetOffsetYAnimation(visual2, NULL);
+            CHECK_BOOL("SetOffsetYAnimation(NULL) fails", hr == E_INVALIDARG);
+
+            /* The compositor runs the animation; one Commit starts it. */
+            hr = device->lpVtbl->Commit(device);
+            if (SUCCEEDED(hr))
+                hr = device->lpVtbl->WaitForCommitCompletion(device);
+            CHECK_HR("Commit with an offset animation", hr);
+
+            hr = visual2->lpVtbl->SetOffsetY(visual2, 0.0f);
+            CHECK_HR("Visual::SetOffsetY replaces the animation", hr);
+            hr = device->lpVtbl->Commit(device);
+            CHECK_HR("Commit after the animation was replaced", hr);
+
+            /* Transform parameters animate the same way, through every
+             * visual using the transform. */
+            {
+                IDCompositionTranslateTransform *translate = NULL;
+
+                hr = device->lpVtbl->CreateTranslateTransform(device, (void **)&translate);
+                CHECK_HR("CreateTranslateTransform", hr);
+                if (translate)
+                {
+                    hr = visual2->lpVtbl->SetTransformObject(visual2, translate);
+                    CHECK_HR("Visual::SetTransformObject(translate)", hr);
+                    hr = translate->lpVtbl->SetOffsetXAnimation(translate, animation);
+                    CHECK_HR("TranslateTransform::SetOffsetXAnimation", hr);
+                    hr = translate->lpVtbl->SetOffsetXAnimation(translate, NULL);
+                    CHECK_BOOL("TranslateTransform::SetOffsetXAnimation(NULL) fails", hr == E_INVALIDARG);
+
+                    hr = device->lpVtbl->Commit(device);
+                    if (SUCCEEDED(hr))
+                        hr = device->lpVtbl->WaitForCommitCompletion(device);
+                    CHECK_HR("Commit with a transform animation", hr);
+
+                    hr = translate->lpVtbl->SetOffsetX(translate, 0.0f);
+                    CHECK_HR("TranslateTransform::SetOffsetX replaces the animation", hr);
+                    hr = visual2->lpVtbl->SetTransformObject(visual2, NULL);
+                    CHECK_HR("Visual::SetTransformObject(NULL) detaches", hr);
+                    hr = device->lpVtbl->Commit(device);
+                    CHECK_HR("Commit after the transform animation was replaced", hr);
+                    translate->lpVtbl->Release(translate);
+                }
+            }
+
+            animation->lpVtbl->Release(animation);
+        }
+    }
+
 done:
     printf("\n=== Results: %d passed, %d failed ===\n", tests_passed, tests_failed);
 